@@ -0,0 +1,471 @@
+// headless frame-time benchmark
+//
+// renders a model into an offscreen framebuffer through an EGL surfaceless context
+// (works on Mesa llvmpipe without a GPU or a display), flies a scripted camera path
+// and prints per-frame CPU/GPU times and percentiles for every RenderMode as JSON;
+// --split adds all five modes at once, from one G-buffer pass (SplitDeferred) and from
+// five forward passes into a 3 x 2 grid of viewports (SplitForward)
+//
+// usage: zmv_bench [--model path] [--frames n] [--warmup n] [--width w] [--height h]
+//                  [--samples n] [--mode name]... [--output file] [--max-p90-ms ms]
+//                  [--vertex-format full|compact] [--instances n] [--split]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glad/glad.h>
+
+#include <zmv/renderer.h>
+
+struct Options {
+    std::string model_filepath = "model/spot.obj";
+    int frames = 300;
+    int warmup = 30;
+    int width = 1600;
+    int height = 900;
+    int samples = 4;
+    std::vector<RenderMode> modes;
+    std::string output_filepath;
+    double max_p90_milliseconds = 0.0;
+    bool compact_vertices = true;
+    // > 1 spawns a grid of instances of the model, see Scene::spawn_grid
+    int instances = 1;
+    bool split = false;
+};
+
+struct ModeResult {
+    std::string name;
+    std::vector<double> cpu_milliseconds;
+    std::vector<double> gpu_milliseconds;
+    FrameStats frame_stats;
+};
+
+const char *render_mode_names[] = {"Position", "Normal", "TexCoords", "Diffuse", "Specular"};
+const RenderMode all_render_modes[] = {
+    RenderMode::Position, RenderMode::Normal, RenderMode::TexCoords, RenderMode::Diffuse, RenderMode::Specular
+};
+
+EGLDisplay display = EGL_NO_DISPLAY;
+EGLContext context = EGL_NO_CONTEXT;
+
+bool parse_options(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "missing value for " << arg << std::endl;
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--model") {
+            options.model_filepath = value();
+        } else if (arg == "--frames") {
+            options.frames = std::max(1, std::atoi(value()));
+        } else if (arg == "--warmup") {
+            options.warmup = std::max(0, std::atoi(value()));
+        } else if (arg == "--width") {
+            options.width = std::max(1, std::atoi(value()));
+        } else if (arg == "--height") {
+            options.height = std::max(1, std::atoi(value()));
+        } else if (arg == "--samples") {
+            options.samples = std::max(0, std::atoi(value()));
+        } else if (arg == "--mode") {
+            const std::string name = value();
+            bool found = false;
+            for (std::size_t m = 0; m < std::size(render_mode_names); ++m) {
+                if (name == render_mode_names[m]) {
+                    options.modes.push_back(all_render_modes[m]);
+                    found = true;
+                }
+            }
+            if (!found) {
+                std::cerr << "unknown render mode " << name << std::endl;
+                return false;
+            }
+        } else if (arg == "--output") {
+            options.output_filepath = value();
+        } else if (arg == "--max-p90-ms") {
+            options.max_p90_milliseconds = std::atof(value());
+        } else if (arg == "--vertex-format") {
+            const std::string format = value();
+            if (format != "full" && format != "compact") {
+                std::cerr << "unknown vertex format " << format << std::endl;
+                return false;
+            }
+            options.compact_vertices = format == "compact";
+        } else if (arg == "--instances") {
+            options.instances = std::max(1, std::atoi(value()));
+        } else if (arg == "--split") {
+            options.split = true;
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (options.modes.empty()) {
+        options.modes.assign(std::begin(all_render_modes), std::end(all_render_modes));
+    }
+    return true;
+}
+
+bool initialize() {
+    // prefer the surfaceless platform, no window system is needed at all
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display) {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cerr << "failed to initialize EGL" << std::endl;
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL does not support desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    // EGL_KHR_no_config_context + EGL_KHR_surfaceless_context, rendering only goes to FBOs
+    context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "failed to create a surfaceless OpenGL 3.3 context" << std::endl;
+        return false;
+    }
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+        std::cerr << "failed to load glad" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void finalize() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+// color + depth renderbuffers standing in for the default framebuffer of the window
+struct Framebuffer {
+    GLuint FBO = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+
+    bool create(int width, int height, int samples) {
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    void destroy() {
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteFramebuffers(1, &FBO);
+    }
+};
+
+// deterministic fly-through: back off, orbit while strafing, then dive forward
+void fly_camera(Renderer &renderer, int frame, int n_frames) {
+    const float delta_time = 1.0f / 60.0f;
+    const float t = static_cast<float>(frame) / n_frames;
+    if (t < 0.2f) {
+        renderer.move_camera(CameraMovement::Backward, delta_time);
+    } else if (t < 0.7f) {
+        renderer.move_camera(CameraMovement::Right, delta_time);
+        renderer.look_around_camera(-1.0f, 0.0f);
+    } else if (t < 0.85f) {
+        renderer.move_camera(CameraMovement::Up, delta_time);
+        renderer.look_around_camera(0.0f, 0.2f);
+    } else {
+        renderer.move_camera(CameraMovement::Forward, delta_time);
+    }
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const double rank = p / 100.0 * (values.size() - 1);
+    const std::size_t lower = static_cast<std::size_t>(rank);
+    const std::size_t upper = std::min(lower + 1, values.size() - 1);
+    return values[lower] + (rank - lower) * (values[upper] - values[lower]);
+}
+
+void write_statistics(std::ostream &out, const std::vector<double> &values) {
+    double sum = 0.0;
+    for (double value : values) {
+        sum += value;
+    }
+    out << "{\"mean\": " << (values.empty() ? 0.0 : sum / values.size())
+        << ", \"min\": " << percentile(values, 0.0)
+        << ", \"p50\": " << percentile(values, 50.0)
+        << ", \"p90\": " << percentile(values, 90.0)
+        << ", \"p99\": " << percentile(values, 99.0)
+        << ", \"max\": " << percentile(values, 100.0) << "}";
+}
+
+void write_values(std::ostream &out, const std::vector<double> &values) {
+    out << "[";
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        out << (i > 0 ? ", " : "") << values[i];
+    }
+    out << "]";
+}
+
+std::string json_string(const std::string &str) {
+    std::string escaped = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+// render_frame draws one frame into the bound framebuffer and returns its counters
+ModeResult run_mode(Renderer &renderer, const Framebuffer &framebuffer, const Options &options, const std::string &name,
+                    const std::function<FrameStats()> &render_frame) {
+    ModeResult result;
+    result.name = name;
+    renderer.reset_camera();
+
+    // one query per measured frame, read back at the end so that no frame waits for the GPU
+    std::vector<GLuint> queries(options.frames);
+    glGenQueries(options.frames, queries.data());
+
+    // shader variants are built on first use, outside of the measured frames
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.FBO);
+    render_frame();
+    while (renderer.get_shaders().get_pending_count() > 0) {
+        renderer.update();
+    }
+
+    const int n_frames = options.warmup + options.frames;
+    for (int frame = 0; frame < n_frames; ++frame) {
+        const bool measured = frame >= options.warmup;
+        const auto start = std::chrono::steady_clock::now();
+        if (measured) {
+            glBeginQuery(GL_TIME_ELAPSED, queries[frame - options.warmup]);
+        }
+
+        fly_camera(renderer, frame, n_frames);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.FBO);
+        glClearColor(0.4f, 0.4f, 0.4f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        renderer.update();
+        result.frame_stats = render_frame();
+
+        if (measured) {
+            glEndQuery(GL_TIME_ELAPSED);
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            result.cpu_milliseconds.push_back(elapsed.count());
+        }
+        // stands in for the buffer swap, keeps the CPU from running ahead by many frames
+        glFlush();
+    }
+
+    for (GLuint query : queries) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        result.gpu_milliseconds.push_back(nanoseconds / 1.0e6);
+    }
+    glDeleteQueries(options.frames, queries.data());
+    return result;
+}
+
+void accumulate(FrameStats &total, const FrameStats &stats) {
+    total.draw_calls += stats.draw_calls;
+    total.state_changes += stats.state_changes;
+    total.state_changes_requested += stats.state_changes_requested;
+    total.state_changes_unsorted += stats.state_changes_unsorted;
+    total.meshes_submitted += stats.meshes_submitted;
+    total.meshes_culled += stats.meshes_culled;
+    total.instances_submitted += stats.instances_submitted;
+    total.instances_culled += stats.instances_culled;
+    total.uniform_bytes += stats.uniform_bytes;
+    total.gbuffer_passes += stats.gbuffer_passes;
+    total.triangles += stats.triangles;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        return 2;
+    }
+    if (!initialize()) {
+        return 1;
+    }
+
+    Framebuffer framebuffer;
+    if (!framebuffer.create(options.width, options.height, options.samples)) {
+        std::cerr << "failed to create the offscreen framebuffer" << std::endl;
+        finalize();
+        return 1;
+    }
+    glViewport(0, 0, options.width, options.height);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_MULTISAMPLE);
+
+    // the renderer logs to stdout, keep it free for the JSON report
+    std::streambuf *stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+    std::vector<ModeResult> results;
+    bool persistent_uniforms = false;
+    double renderer_milliseconds = 0.0;
+    double first_frame_milliseconds = 0.0;
+    std::size_t n_cached_programs = 0;
+    {
+        // startup: renderer setup and the first, empty frame
+        const auto startup = std::chrono::steady_clock::now();
+        auto renderer = std::make_unique<Renderer>(options.width, options.height);
+        renderer_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup).count();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.FBO);
+        renderer->update();
+        renderer->render();
+        glFinish();
+        first_frame_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup).count();
+        std::cerr << "[Bench] first frame after " << first_frame_milliseconds << " ms" << std::endl;
+
+        LoadOptions load_options = renderer->get_load_options();
+        load_options.compact_vertices = options.compact_vertices;
+        renderer->set_load_options(load_options);
+
+        const auto load_start = std::chrono::steady_clock::now();
+        renderer->load_model(options.model_filepath);
+        while (renderer->is_loading_model()) {
+            renderer->update();
+        }
+        const std::chrono::duration<double, std::milli> load_time = std::chrono::steady_clock::now() - load_start;
+        std::cerr << "[Bench] model loaded in " << load_time.count() << " ms" << std::endl;
+        if (options.instances > 1) {
+            renderer->spawn_instances(static_cast<std::size_t>(options.instances));
+        }
+
+        auto render = [&]() {
+            renderer->render();
+            return renderer->get_frame_stats();
+        };
+        for (RenderMode mode : options.modes) {
+            renderer->set_render_mode(mode);
+            results.push_back(run_mode(*renderer, framebuffer, options, render_mode_names[static_cast<int>(mode)], render));
+        }
+
+        if (options.split) {
+            // the camera moves every frame, so every frame redraws the G-buffer
+            renderer->set_deferred(true);
+            renderer->set_split_view(true);
+            results.push_back(run_mode(*renderer, framebuffer, options, "SplitDeferred", render));
+            renderer->set_deferred(false);
+            renderer->set_split_view(false);
+
+            // the same grid as the split view, one forward pass per cell
+            auto render_split = [&]() {
+                FrameStats total;
+                for (int m = 0; m < static_cast<int>(std::size(all_render_modes)); ++m) {
+                    const int cell_width = options.width / 3;
+                    const int cell_height = options.height / 2;
+                    glViewport(m % 3 * cell_width, (1 - m / 3) * cell_height, cell_width, cell_height);
+                    renderer->set_render_mode(all_render_modes[m]);
+                    renderer->render();
+                    accumulate(total, renderer->get_frame_stats());
+                }
+                glViewport(0, 0, options.width, options.height);
+                return total;
+            };
+            results.push_back(run_mode(*renderer, framebuffer, options, "SplitForward", render_split));
+        }
+        persistent_uniforms = renderer->get_uniform_ring().is_persistent();
+        n_cached_programs = ProgramCache::instance().get_hit_count();
+        renderer->destroy();
+    }
+    std::cout.rdbuf(stdout_buffer);
+
+    // report
+    std::ostringstream out;
+    out << "{\n";
+    out << "  \"model\": " << json_string(options.model_filepath) << ",\n";
+    out << "  \"gl_renderer\": " << json_string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) << ",\n";
+    out << "  \"gl_version\": " << json_string(reinterpret_cast<const char*>(glGetString(GL_VERSION))) << ",\n";
+    out << "  \"width\": " << options.width << ", \"height\": " << options.height << ", \"samples\": " << options.samples << ",\n";
+    out << "  \"vertex_format\": " << json_string(options.compact_vertices ? "compact" : "full") << ", \"instances\": " << options.instances
+        << ", \"persistent_uniforms\": " << (persistent_uniforms ? "true" : "false") << ",\n";
+    out << "  \"startup\": {\"renderer_ms\": " << renderer_milliseconds << ", \"first_frame_ms\": " << first_frame_milliseconds
+        << ", \"programs_from_cache\": " << n_cached_programs << "},\n";
+    out << "  \"frames\": " << options.frames << ", \"warmup\": " << options.warmup << ",\n";
+    out << "  \"modes\": {\n";
+    bool over_budget = false;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const ModeResult &result = results[i];
+        out << "    " << json_string(result.name) << ": {\n";
+        out << "      \"draw_calls\": " << result.frame_stats.draw_calls << ", \"state_changes\": " << result.frame_stats.state_changes
+            << ", \"state_changes_requested\": " << result.frame_stats.state_changes_requested
+            << ", \"state_changes_unsorted\": " << result.frame_stats.state_changes_unsorted
+            << ", \"uniform_bytes\": " << result.frame_stats.uniform_bytes << ", \"gbuffer_passes\": " << result.frame_stats.gbuffer_passes
+            << ", \"meshes_submitted\": " << result.frame_stats.meshes_submitted << ", \"meshes_culled\": " << result.frame_stats.meshes_culled
+            << ", \"instances_submitted\": " << result.frame_stats.instances_submitted << ", \"instances_culled\": " << result.frame_stats.instances_culled << ",\n";
+        out << "      \"cpu_ms\": ";
+        write_statistics(out, result.cpu_milliseconds);
+        out << ",\n      \"gpu_ms\": ";
+        write_statistics(out, result.gpu_milliseconds);
+        out << ",\n      \"cpu_ms_frames\": ";
+        write_values(out, result.cpu_milliseconds);
+        out << ",\n      \"gpu_ms_frames\": ";
+        write_values(out, result.gpu_milliseconds);
+        out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+
+        const double p90 = std::max(percentile(result.cpu_milliseconds, 90.0), percentile(result.gpu_milliseconds, 90.0));
+        if (options.max_p90_milliseconds > 0.0 && p90 > options.max_p90_milliseconds) {
+            std::cerr << "[Bench] " << result.name
+                << " p90 " << p90 << " ms exceeds " << options.max_p90_milliseconds << " ms" << std::endl;
+            over_budget = true;
+        }
+    }
+    out << "  }\n}\n";
+
+    if (options.output_filepath.empty()) {
+        std::cout << out.str();
+    } else {
+        std::ofstream(options.output_filepath) << out.str();
+    }
+
+    framebuffer.destroy();
+    finalize();
+    return over_budget ? 1 : 0;
+}
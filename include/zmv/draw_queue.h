@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <zmv/frame_stats.h>
+#include <zmv/gl_state_cache.h>
+#include <zmv/mesh.h>
+#include <zmv/profiler.h>
+#include <zmv/shader.h>
+
+// per-model uniforms of the vertex shader, see VertexQuantization
+struct DrawUniforms {
+    glm::vec3 position_offset = glm::vec3(0.0f);
+    glm::vec3 position_scale = glm::vec3(1.0f);
+};
+
+// 64 bit sort key, most expensive state change first:
+// program 4 | uniforms 8 | texture set 8 | vertex array 12 | material 16 | depth 16
+// the fields only decide the order, a collision costs a redundant bind but never a wrong one
+struct DrawKey {
+    static std::uint64_t make(unsigned program, unsigned uniforms, std::size_t texture_set,
+                              std::size_t vertex_array, std::size_t material, float depth) {
+        return (static_cast<std::uint64_t>(program & 0xf) << 60) |
+            (static_cast<std::uint64_t>(uniforms & 0xff) << 52) |
+            (static_cast<std::uint64_t>(texture_set & 0xff) << 44) |
+            (static_cast<std::uint64_t>(vertex_array & 0xfff) << 32) |
+            (static_cast<std::uint64_t>(material & 0xffff) << 16) |
+            depth_bits(depth);
+    }
+
+    // the bits of a non-negative float grow with its value, the top 16 keep sign, exponent
+    // and 7 mantissa bits, i.e. front to back within 1%
+    static std::uint64_t depth_bits(float depth) {
+        depth = std::max(depth, 0.0f);
+        std::uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits >> 16;
+    }
+};
+
+// everything one glDrawElementsBaseVertex / glMultiDrawElementsBaseVertex needs, instanced draws
+// repeat each of its ranges for n_instances
+struct DrawCommand {
+    std::uint64_t key = 0;
+    const Shader *shader = nullptr;
+    const DrawUniforms *uniforms = nullptr;
+    // bound to units 0, 1, ...; may be null
+    const TextureSet *textures = nullptr;
+    GLuint vertex_array = 0;
+    GLuint material_buffer = 0;
+    GLintptr material_offset = 0;
+    GLenum index_type = GL_UNSIGNED_INT;
+    // draws [first_draw, first_draw + n_draws) of the queue
+    std::size_t first_draw = 0;
+    std::size_t n_draws = 0;
+    // instances of the per-instance matrix buffer of the vertex array, see Model::set_instances
+    GLsizei n_instances = 1;
+    // GPU timer scope while mesh timing is on
+    const char *profile_name = nullptr;
+    int profile_index = -1;
+};
+
+// per-frame command buffer: models push commands in any order, execute() radix sorts them by key
+// and issues them through a GLStateCache, so that only state that differs from the previous
+// command is bound
+class DrawQueue {
+public:
+    void clear() {
+        commands.clear();
+        counts.clear();
+        offsets.clear();
+        base_vertices.clear();
+        programs.clear();
+        uniform_sets.clear();
+    }
+
+    std::size_t size() const {
+        return commands.size();
+    }
+
+    // small per-frame numbers for DrawKey, the same value gets the same slot within a frame
+    unsigned program_slot(const Shader &shader) {
+        return slot(programs, &shader);
+    }
+
+    unsigned uniforms_slot(const DrawUniforms &uniforms) {
+        return slot(uniform_sets, &uniforms);
+    }
+
+    // appends one draw range, returns its index for DrawCommand::first_draw
+    std::size_t add_draw(GLsizei count, const void *offset, GLint base_vertex) {
+        counts.push_back(count);
+        offsets.push_back(offset);
+        base_vertices.push_back(base_vertex);
+        return counts.size() - 1;
+    }
+
+    std::size_t draw_count() const {
+        return counts.size();
+    }
+
+    void push(const DrawCommand &command) {
+        commands.push_back(command);
+    }
+
+    void execute(GLStateCache &state) {
+        FrameStats &stats = FrameStats::current();
+
+        // what the commands would cost in the order they were pushed
+        GLStateCache unsorted = state.dry_copy();
+        const DrawUniforms *unsorted_uniforms = nullptr;
+        for (const auto &command : commands) {
+            unsorted_uniforms = apply_state(unsorted, command, unsorted_uniforms, false);
+        }
+        unsorted.bind_vertex_array(0);
+        unsorted.use_program(0);
+        stats.state_changes_unsorted += unsorted.get_issued_count();
+
+        sort();
+
+        Profiler &profiler = Profiler::instance();
+        const bool profile_commands = profiler.is_mesh_timing_enabled();
+        state.reset_counters();
+        const DrawUniforms *current_uniforms = nullptr;
+        for (const auto &item : order) {
+            const DrawCommand &command = commands[item.index];
+            current_uniforms = apply_state(state, command, current_uniforms, true);
+
+            const int scope = profile_commands && command.profile_name ?
+                profiler.begin_scope(command.profile_name, true, command.profile_index) : -1;
+            if (command.n_instances != 1) {
+                // GL 3.3 has no instanced multi-draw, one instanced draw per range
+                for (std::size_t i = command.first_draw; i < command.first_draw + command.n_draws; ++i) {
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, counts[i], command.index_type,
+                                                      const_cast<void*>(offsets[i]), command.n_instances, base_vertices[i]);
+                }
+                stats.draw_calls += command.n_draws;
+            } else if (command.n_draws == 1) {
+                glDrawElementsBaseVertex(GL_TRIANGLES, counts[command.first_draw], command.index_type,
+                                         const_cast<void*>(offsets[command.first_draw]), base_vertices[command.first_draw]);
+                stats.draw_calls++;
+            } else {
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data() + command.first_draw, command.index_type,
+                                              offsets.data() + command.first_draw, static_cast<GLsizei>(command.n_draws),
+                                              base_vertices.data() + command.first_draw);
+                stats.draw_calls++;
+            }
+            profiler.end_scope(scope);
+        }
+        state.bind_vertex_array(0);
+        state.use_program(0);
+        stats.state_changes += state.get_issued_count();
+        stats.state_changes_requested += state.get_requested_count();
+    }
+
+private:
+    struct SortItem {
+        std::uint64_t key;
+        std::uint32_t index;
+    };
+
+    std::vector<DrawCommand> commands;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> base_vertices;
+    std::vector<const Shader*> programs;
+    std::vector<const DrawUniforms*> uniform_sets;
+    std::vector<SortItem> order;
+    std::vector<SortItem> scratch;
+
+    template <typename T>
+    static unsigned slot(std::vector<const T*> &slots, const T *value) {
+        const auto it = std::find(slots.begin(), slots.end(), value);
+        if (it != slots.end()) {
+            return static_cast<unsigned>(it - slots.begin());
+        }
+        slots.push_back(value);
+        return static_cast<unsigned>(slots.size() - 1);
+    }
+
+    // returns the uniforms now set on the program, they are only uploaded when issue is set
+    static const DrawUniforms *apply_state(GLStateCache &state, const DrawCommand &command,
+                                           const DrawUniforms *current_uniforms, bool issue) {
+        if (state.use_program(command.shader->get_program())) {
+            current_uniforms = nullptr;
+        }
+        if (command.uniforms && command.uniforms != current_uniforms) {
+            if (issue) {
+                const Shader &shader = *command.shader;
+                glUniform3fv(shader.location(Uniform::PositionOffset), 1, glm::value_ptr(command.uniforms->position_offset));
+                glUniform3fv(shader.location(Uniform::PositionScale), 1, glm::value_ptr(command.uniforms->position_scale));
+            }
+            state.count_uniforms(2);
+            current_uniforms = command.uniforms;
+        }
+        if (command.textures) {
+            for (std::size_t unit = 0; unit < command.textures->size(); ++unit) {
+                state.bind_texture(static_cast<GLuint>(unit), (*command.textures)[unit]);
+            }
+        }
+        state.bind_vertex_array(command.vertex_array);
+        state.bind_uniform_range(material_block_binding, command.material_buffer, command.material_offset, sizeof(MaterialBlock));
+        return current_uniforms;
+    }
+
+    // LSD radix sort on 8 bit digits, passes over digits that are equal for every key are skipped
+    void sort() {
+        order.resize(commands.size());
+        for (std::size_t i = 0; i < commands.size(); ++i) {
+            order[i] = {commands[i].key, static_cast<std::uint32_t>(i)};
+        }
+        scratch.resize(order.size());
+
+        std::uint64_t varying = 0;
+        for (const auto &item : order) {
+            varying |= item.key ^ order[0].key;
+        }
+        for (unsigned shift = 0; shift < 64; shift += 8) {
+            if (((varying >> shift) & 0xff) == 0) {
+                continue;
+            }
+            std::size_t histogram[257] = {};
+            for (const auto &item : order) {
+                histogram[((item.key >> shift) & 0xff) + 1]++;
+            }
+            for (std::size_t digit = 0; digit < 256; ++digit) {
+                histogram[digit + 1] += histogram[digit];
+            }
+            for (const auto &item : order) {
+                scratch[histogram[(item.key >> shift) & 0xff]++] = item;
+            }
+            order.swap(scratch);
+        }
+    }
+};
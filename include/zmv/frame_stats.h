@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+
+// counters of the GL work submitted while rendering a frame
+struct FrameStats {
+    std::size_t draw_calls = 0;
+    // program, VAO and texture binds plus uniform updates
+    std::size_t state_changes = 0;
+    // the same for the draw queue before redundant binds are filtered, and filtered in submission
+    // order instead of sorted, see DrawQueue::execute
+    std::size_t state_changes_requested = 0;
+    std::size_t state_changes_unsorted = 0;
+    // meshes that passed / failed frustum culling
+    std::size_t meshes_submitted = 0;
+    std::size_t meshes_culled = 0;
+    // model instances that passed / failed frustum culling, see Scene
+    std::size_t instances_submitted = 0;
+    std::size_t instances_culled = 0;
+    // per-frame data written to the UniformRing
+    std::size_t uniform_bytes = 0;
+    // geometry passes into the G-buffer, 0 when the deferred path reused the last one
+    std::size_t gbuffer_passes = 0;
+    // triangles of the LODs drawn
+    std::size_t triangles = 0;
+
+    static FrameStats &current() {
+        static FrameStats stats;
+        return stats;
+    }
+
+    void reset() {
+        *this = FrameStats();
+    }
+};
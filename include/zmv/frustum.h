@@ -0,0 +1,157 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define ZMV_FRUSTUM_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include <glm/glm.hpp>
+#include <zmv/mesh.h>
+
+// six normalized planes (n.x, n.y, n.z, d) pointing inwards, extracted from projection * view
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum from_matrix(const glm::mat4 &view_projection) {
+        // rows of the matrix, glm is column major
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i) {
+            rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+        }
+
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0]; // left
+        frustum.planes[1] = rows[3] - rows[0]; // right
+        frustum.planes[2] = rows[3] + rows[1]; // bottom
+        frustum.planes[3] = rows[3] - rows[1]; // top
+        frustum.planes[4] = rows[3] + rows[2]; // near
+        frustum.planes[5] = rows[3] - rows[2]; // far
+        for (auto &plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    // false when the sphere is completely outside of one of the planes
+    bool intersects(const glm::vec3 &center, float radius) const {
+        for (const auto &plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// mesh AABBs in structure of arrays layout, tested four at a time against a frustum
+class CullingBounds {
+public:
+    void build(const std::vector<Bounds> &bounds) {
+        n_bounds = bounds.size();
+        // padded to a multiple of 4 so the SIMD loop needs no tail
+        const std::size_t n_padded = (n_bounds + 3) & ~static_cast<std::size_t>(3);
+        for (auto *array : {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z}) {
+            array->assign(n_padded, 0.0f);
+        }
+        for (std::size_t i = 0; i < n_bounds; ++i) {
+            const glm::vec3 center = 0.5f * (bounds[i].min + bounds[i].max);
+            const glm::vec3 extent = 0.5f * (bounds[i].max - bounds[i].min);
+            center_x[i] = center.x;
+            center_y[i] = center.y;
+            center_z[i] = center.z;
+            extent_x[i] = extent.x;
+            extent_y[i] = extent.y;
+            extent_z[i] = extent.z;
+        }
+    }
+
+    std::size_t size() const {
+        return n_bounds;
+    }
+
+    // visible[i] is 1 when box i intersects the frustum, conservative for boxes near the corners
+    void cull(const Frustum &frustum, std::vector<std::uint8_t> &visible) const {
+        visible.resize(center_x.size());
+#ifdef ZMV_FRUSTUM_SSE
+        cull_sse(frustum, visible.data());
+#else
+        cull_scalar(frustum, visible.data());
+#endif
+        visible.resize(n_bounds);
+    }
+
+private:
+    std::size_t n_bounds = 0;
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> extent_x;
+    std::vector<float> extent_y;
+    std::vector<float> extent_z;
+
+    // a box is outside when n . center + |n| . extent + d < 0 for any plane
+    void cull_scalar(const Frustum &frustum, std::uint8_t *visible) const {
+        for (std::size_t i = 0; i < center_x.size(); ++i) {
+            bool inside = true;
+            for (const auto &plane : frustum.planes) {
+                const float distance =
+                    plane.x * center_x[i] + plane.y * center_y[i] + plane.z * center_z[i] +
+                    std::fabs(plane.x) * extent_x[i] + std::fabs(plane.y) * extent_y[i] + std::fabs(plane.z) * extent_z[i] +
+                    plane.w;
+                if (distance < 0.0f) {
+                    inside = false;
+                    break;
+                }
+            }
+            visible[i] = inside;
+        }
+    }
+
+#ifdef ZMV_FRUSTUM_SSE
+    void cull_sse(const Frustum &frustum, std::uint8_t *visible) const {
+        __m128 normal_x[6], normal_y[6], normal_z[6];
+        __m128 abs_x[6], abs_y[6], abs_z[6];
+        __m128 offset[6];
+        for (int p = 0; p < 6; ++p) {
+            const glm::vec4 &plane = frustum.planes[p];
+            normal_x[p] = _mm_set1_ps(plane.x);
+            normal_y[p] = _mm_set1_ps(plane.y);
+            normal_z[p] = _mm_set1_ps(plane.z);
+            abs_x[p] = _mm_set1_ps(std::fabs(plane.x));
+            abs_y[p] = _mm_set1_ps(std::fabs(plane.y));
+            abs_z[p] = _mm_set1_ps(std::fabs(plane.z));
+            offset[p] = _mm_set1_ps(plane.w);
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        for (std::size_t i = 0; i < center_x.size(); i += 4) {
+            const __m128 cx = _mm_loadu_ps(&center_x[i]);
+            const __m128 cy = _mm_loadu_ps(&center_y[i]);
+            const __m128 cz = _mm_loadu_ps(&center_z[i]);
+            const __m128 ex = _mm_loadu_ps(&extent_x[i]);
+            const __m128 ey = _mm_loadu_ps(&extent_y[i]);
+            const __m128 ez = _mm_loadu_ps(&extent_z[i]);
+
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < 6; ++p) {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(normal_x[p], cx), offset[p]);
+                distance = _mm_add_ps(distance, _mm_mul_ps(normal_y[p], cy));
+                distance = _mm_add_ps(distance, _mm_mul_ps(normal_z[p], cz));
+                distance = _mm_add_ps(distance, _mm_mul_ps(abs_x[p], ex));
+                distance = _mm_add_ps(distance, _mm_mul_ps(abs_y[p], ey));
+                distance = _mm_add_ps(distance, _mm_mul_ps(abs_z[p], ez));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+            }
+
+            const int mask = _mm_movemask_ps(inside);
+            visible[i] = mask & 1;
+            visible[i + 1] = (mask >> 1) & 1;
+            visible[i + 2] = (mask >> 2) & 1;
+            visible[i + 3] = (mask >> 3) & 1;
+        }
+    }
+#endif
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include <zmv/gl_object.h>
+
+// render targets of the deferred path: one geometry pass writes every RenderMode channel
+// (PASS_GBUFFER of shaders/material.frag), a fullscreen pass shows one of them or all at once (shaders/gbuffer_view.frag)
+class GBuffer {
+public:
+    // position, normal, texture coords, diffuse, specular; in RenderMode order
+    static constexpr int n_channels = 5;
+
+    bool create(int width, int height) {
+        destroy();
+        this->width = width;
+        this->height = height;
+
+        framebuffer.create();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        // positions and normals as they are, not yet mapped to colors
+        const GLenum formats[n_channels] = {GL_RGBA16F, GL_RGBA16F, GL_RG16F, GL_RGBA8, GL_RGBA8};
+        GLenum draw_buffers[n_channels];
+        for (int i = 0; i < n_channels; ++i) {
+            textures[i].create();
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+            // exact texels when shown at full size
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+            draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDrawBuffers(n_channels, draw_buffers);
+
+        depth.create();
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+        const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            std::cerr << "[GBuffer] framebuffer is incomplete" << std::endl;
+            destroy();
+        }
+        return complete;
+    }
+
+    void destroy() {
+        for (auto &texture : textures) {
+            texture.reset();
+        }
+        depth.reset();
+        framebuffer.reset();
+        width = 0;
+        height = 0;
+    }
+
+    operator bool() const {
+        return framebuffer != 0;
+    }
+
+    int get_width() const {
+        return width;
+    }
+
+    int get_height() const {
+        return height;
+    }
+
+    GLuint get_texture(int channel) const {
+        return textures[channel];
+    }
+
+    // binds and clears all channels, uncovered pixels keep a position w of 0
+    void begin_pass() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        const GLfloat far_depth = 1.0f;
+        for (int i = 0; i < n_channels; ++i) {
+            glClearBufferfv(GL_COLOR, i, zero);
+        }
+        glClearBufferfv(GL_DEPTH, 0, &far_depth);
+    }
+
+private:
+    int width = 0;
+    int height = 0;
+    GLFramebuffer framebuffer;
+    std::array<GLTexture, n_channels> textures;
+    GLRenderbuffer depth;
+};
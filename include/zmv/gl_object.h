@@ -0,0 +1,109 @@
+#pragma once
+#include <utility>
+
+#include <glad/glad.h>
+
+// move-only owner of a GL object name, deleted by reset() or on destruction;
+// the GL context must still be current then, Model::destroy releases everything early
+template <typename Traits>
+class GLObject {
+public:
+    GLObject() { }
+
+    GLObject(const GLObject &) = delete;
+    GLObject &operator=(const GLObject &) = delete;
+
+    GLObject(GLObject &&other) noexcept : name(std::exchange(other.name, 0)) { }
+
+    GLObject &operator=(GLObject &&other) noexcept {
+        if (this != &other) {
+            reset();
+            name = std::exchange(other.name, 0);
+        }
+        return *this;
+    }
+
+    ~GLObject() {
+        reset();
+    }
+
+    // replaces the owned object with a new one
+    void create() {
+        reset();
+        Traits::create(name);
+    }
+
+    void reset() {
+        if (name != 0) {
+            Traits::destroy(name);
+            name = 0;
+        }
+    }
+
+    GLuint get() const {
+        return name;
+    }
+
+    operator GLuint() const {
+        return name;
+    }
+
+private:
+    GLuint name = 0;
+};
+
+struct GLBufferTraits {
+    static void create(GLuint &name) {
+        glGenBuffers(1, &name);
+    }
+
+    static void destroy(GLuint &name) {
+        glDeleteBuffers(1, &name);
+    }
+};
+
+struct GLVertexArrayTraits {
+    static void create(GLuint &name) {
+        glGenVertexArrays(1, &name);
+    }
+
+    static void destroy(GLuint &name) {
+        glDeleteVertexArrays(1, &name);
+    }
+};
+
+struct GLTextureTraits {
+    static void create(GLuint &name) {
+        glGenTextures(1, &name);
+    }
+
+    static void destroy(GLuint &name) {
+        glDeleteTextures(1, &name);
+    }
+};
+
+struct GLFramebufferTraits {
+    static void create(GLuint &name) {
+        glGenFramebuffers(1, &name);
+    }
+
+    static void destroy(GLuint &name) {
+        glDeleteFramebuffers(1, &name);
+    }
+};
+
+struct GLRenderbufferTraits {
+    static void create(GLuint &name) {
+        glGenRenderbuffers(1, &name);
+    }
+
+    static void destroy(GLuint &name) {
+        glDeleteRenderbuffers(1, &name);
+    }
+};
+
+using GLBuffer = GLObject<GLBufferTraits>;
+using GLVertexArray = GLObject<GLVertexArrayTraits>;
+using GLTexture = GLObject<GLTextureTraits>;
+using GLFramebuffer = GLObject<GLFramebufferTraits>;
+using GLRenderbuffer = GLObject<GLRenderbufferTraits>;
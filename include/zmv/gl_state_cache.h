@@ -0,0 +1,138 @@
+#pragma once
+#include <array>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+// shadow copy of the GL state the draw queue touches, binds that would not change anything are
+// skipped; code outside of DrawQueue::execute that changes the same state must call invalidate()
+//
+// a dry run cache only counts, DrawQueue uses one to tell what the unsorted commands would have cost
+class GLStateCache {
+public:
+    static constexpr std::size_t max_texture_units = 16;
+    static constexpr std::size_t max_uniform_bindings = 4;
+
+    explicit GLStateCache(bool dry_run = false) : dry_run(dry_run) {
+        invalidate();
+    }
+
+    // same state, but counting from zero and without touching GL
+    GLStateCache dry_copy() const {
+        GLStateCache copy = *this;
+        copy.dry_run = true;
+        copy.n_requested = 0;
+        copy.n_issued = 0;
+        return copy;
+    }
+
+    // binds asked for and binds that reached GL since the last reset_counters()
+    std::size_t get_requested_count() const {
+        return n_requested;
+    }
+
+    std::size_t get_issued_count() const {
+        return n_issued;
+    }
+
+    void reset_counters() {
+        n_requested = 0;
+        n_issued = 0;
+    }
+
+    // forget everything, the next bind of each kind always reaches GL
+    void invalidate() {
+        program = invalid;
+        vertex_array = invalid;
+        active_unit = invalid;
+        textures.fill(invalid);
+        for (auto &range : uniform_ranges) {
+            range = UniformRange();
+        }
+    }
+
+    // true when the program changed, its uniforms must then be set again
+    bool use_program(GLuint program) {
+        if (!changed(this->program, program)) {
+            return false;
+        }
+        if (!dry_run) {
+            glUseProgram(program);
+        }
+        return true;
+    }
+
+    void bind_vertex_array(GLuint vertex_array) {
+        if (changed(this->vertex_array, vertex_array) && !dry_run) {
+            glBindVertexArray(vertex_array);
+        }
+    }
+
+    void bind_texture(GLuint unit, GLuint texture) {
+        if (unit >= max_texture_units) {
+            return ;
+        }
+        if (!changed(textures[unit], texture)) {
+            return ;
+        }
+        if (dry_run) {
+            return ;
+        }
+        if (active_unit != unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            active_unit = unit;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    void bind_uniform_range(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        if (binding >= max_uniform_bindings) {
+            return ;
+        }
+        UniformRange &range = uniform_ranges[binding];
+        n_requested++;
+        if (range.buffer == buffer && range.offset == offset && range.size == size) {
+            return ;
+        }
+        range = {buffer, offset, size};
+        n_issued++;
+        if (!dry_run) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+        }
+    }
+
+    // n uniforms of the current program are set by the caller, they are not tracked
+    void count_uniforms(std::size_t n) {
+        n_requested += n;
+        n_issued += n;
+    }
+
+private:
+    static constexpr GLuint invalid = ~0u;
+
+    struct UniformRange {
+        GLuint buffer = invalid;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+
+    bool dry_run;
+    std::size_t n_requested = 0;
+    std::size_t n_issued = 0;
+    GLuint program;
+    GLuint vertex_array;
+    GLuint active_unit;
+    std::array<GLuint, max_texture_units> textures;
+    std::array<UniformRange, max_uniform_bindings> uniform_ranges;
+
+    // counts the request, true when it has to reach GL
+    bool changed(GLuint &current, GLuint value) {
+        n_requested++;
+        if (current == value) {
+            return false;
+        }
+        current = value;
+        n_issued++;
+        return true;
+    }
+};
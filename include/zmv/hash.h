@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// 64-bit FNV-1a, used to key the on-disk caches
+class Hash {
+public:
+    Hash() { }
+
+    Hash &add(const void *data, std::size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            value ^= bytes[i];
+            value *= 0x100000001b3ull;
+        }
+        return *this;
+    }
+
+    Hash &add(const std::string &str) {
+        // include the length so that ("ab", "c") and ("a", "bc") differ
+        add(static_cast<std::uint64_t>(str.size()));
+        return add(str.data(), str.size());
+    }
+
+    template <typename T>
+    Hash &add(const T &value) {
+        return add(&value, sizeof(T));
+    }
+
+    std::uint64_t digest() const {
+        return value;
+    }
+
+    std::string hex() const {
+        char str[17];
+        std::snprintf(str, sizeof(str), "%016llx", static_cast<unsigned long long>(value));
+        return str;
+    }
+
+private:
+    std::uint64_t value = 0xcbf29ce484222325ull;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glad/glad.h>
+
+// CPU copy of a mesh's indices, 16 bit when every vertex can be addressed with them, 32 bit otherwise
+class IndexBuffer {
+public:
+    // meshes with more vertices are split at import time, see MeshOptimizer::split
+    static constexpr std::size_t max_short_vertices = 65536;
+
+    IndexBuffer() { }
+
+    IndexBuffer(const unsigned int *indices, std::size_t n_indices, std::size_t n_vertices, bool allow_short = true) {
+        assign(indices, n_indices, n_vertices, allow_short);
+    }
+
+    static GLenum type_for(std::size_t n_vertices, bool allow_short = true) {
+        return allow_short && n_vertices <= max_short_vertices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    }
+
+    static std::size_t size_of(GLenum type) {
+        return type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+    }
+
+    void assign(const unsigned int *indices, std::size_t n_indices, std::size_t n_vertices, bool allow_short = true) {
+        type = type_for(n_vertices, allow_short);
+        n_elements = n_indices;
+        bytes.resize(n_indices * index_size());
+        if (type == GL_UNSIGNED_SHORT) {
+            std::uint16_t *shorts = reinterpret_cast<std::uint16_t*>(bytes.data());
+            for (std::size_t i = 0; i < n_indices; ++i) {
+                shorts[i] = static_cast<std::uint16_t>(indices[i]);
+            }
+        } else if (n_indices > 0) {
+            std::memcpy(bytes.data(), indices, bytes.size());
+        }
+    }
+
+    // frees the CPU copy once it is on the GPU, type and size stay valid for drawing
+    void release() {
+        bytes.clear();
+        bytes.shrink_to_fit();
+    }
+
+    void clear() {
+        type = GL_UNSIGNED_INT;
+        n_elements = 0;
+        bytes.clear();
+        bytes.shrink_to_fit();
+    }
+
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, as passed to glDrawElements
+    GLenum index_type() const {
+        return type;
+    }
+
+    std::size_t index_size() const {
+        return size_of(type);
+    }
+
+    std::size_t size() const {
+        return n_elements;
+    }
+
+    bool empty() const {
+        return n_elements == 0;
+    }
+
+    std::size_t size_in_bytes() const {
+        return n_elements * index_size();
+    }
+
+    // nullptr after release()
+    const void *data() const {
+        return bytes.empty() ? nullptr : bytes.data();
+    }
+
+    unsigned int operator[](std::size_t i) const {
+        if (type == GL_UNSIGNED_SHORT) {
+            return reinterpret_cast<const std::uint16_t*>(bytes.data())[i];
+        }
+        return reinterpret_cast<const std::uint32_t*>(bytes.data())[i];
+    }
+
+private:
+    GLenum type = GL_UNSIGNED_INT;
+    std::size_t n_elements = 0;
+    std::vector<unsigned char> bytes;
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+
+#include <glm/glm.hpp>
+#include <zmv/mesh.h>
+
+// picks the coarsest LOD of a mesh whose simplification error stays below a size on screen
+struct LodSelector {
+    glm::vec3 eye;
+    // pixels covered by one model space unit at distance 1, i.e. screen height / (2 tan(fov / 2))
+    float pixels_per_unit;
+    float max_error_pixels = 1.0f;
+    // -1 selects by screen space error, otherwise this level or the coarsest the mesh has
+    int forced_level = -1;
+
+    static LodSelector from_camera(const glm::mat4 &view, const glm::mat4 &projection, int height) {
+        LodSelector selector;
+        // the view matrix is a rotation R and a translation t, the eye sits at -R^T t
+        const glm::vec3 translation(view[3].x, view[3].y, view[3].z);
+        selector.eye = -glm::vec3(
+            glm::dot(glm::vec3(view[0].x, view[0].y, view[0].z), translation),
+            glm::dot(glm::vec3(view[1].x, view[1].y, view[1].z), translation),
+            glm::dot(glm::vec3(view[2].x, view[2].y, view[2].z), translation)
+        );
+        selector.pixels_per_unit = 0.5f * projection[1][1] * height;
+        return selector;
+    }
+
+    // from the eye to the closest point of the bounding sphere, negative around the eye
+    float distance(const Bounds &bounds) const {
+        return glm::length(bounds.center - eye) - bounds.radius;
+    }
+
+    // diameter of the bounding sphere on screen in pixels, unbounded around the eye
+    float screen_size(const Bounds &bounds) const {
+        const float distance = this->distance(bounds);
+        if (distance <= 0.0f) {
+            return std::numeric_limits<float>::max();
+        }
+        return 2.0f * bounds.radius * pixels_per_unit / distance;
+    }
+
+    std::size_t select(const Mesh &mesh) const {
+        const std::size_t n_levels = mesh.lods.size();
+        if (forced_level >= 0) {
+            return std::min(static_cast<std::size_t>(forced_level), n_levels - 1);
+        }
+
+        // closest point of the bounding sphere, meshes around the eye always get full detail
+        const float distance = this->distance(mesh.bounds);
+        if (distance <= 0.0f) {
+            return 0;
+        }
+        const float pixels_per_error = pixels_per_unit / distance;
+        for (std::size_t level = n_levels - 1; level > 0; --level) {
+            if (mesh.lods[level].error * pixels_per_error <= max_error_pixels) {
+                return level;
+            }
+        }
+        return 0;
+    }
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+// resident set size of the process, zero where the platform has no cheap way to read it
+struct MemoryUsage {
+    std::size_t resident_bytes = 0;
+    std::size_t peak_resident_bytes = 0;
+
+    static MemoryUsage current() {
+        MemoryUsage usage;
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            usage.resident_bytes = counters.WorkingSetSize;
+            usage.peak_resident_bytes = counters.PeakWorkingSetSize;
+        }
+#elif defined(__linux__)
+        // VmRSS and its high water mark VmHWM, in kB
+        std::FILE *status = std::fopen("/proc/self/status", "r");
+        if (status) {
+            char line[256];
+            while (std::fgets(line, sizeof(line), status)) {
+                unsigned long long kilobytes = 0;
+                if (std::strncmp(line, "VmRSS:", 6) == 0 && std::sscanf(line + 6, "%llu", &kilobytes) == 1) {
+                    usage.resident_bytes = static_cast<std::size_t>(kilobytes) * 1024;
+                } else if (std::strncmp(line, "VmHWM:", 6) == 0 && std::sscanf(line + 6, "%llu", &kilobytes) == 1) {
+                    usage.peak_resident_bytes = static_cast<std::size_t>(kilobytes) * 1024;
+                }
+            }
+            std::fclose(status);
+        }
+#endif
+        return usage;
+    }
+};
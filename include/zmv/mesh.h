@@ -1,17 +1,19 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <zmv/frame_stats.h>
+#include <zmv/gl_object.h>
+#include <zmv/index_buffer.h>
 #include <zmv/shader.h>
+#include <zmv/shader_library.h>
 #include <zmv/texture.h>
-
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec2 tex_coords;
-};
+#include <zmv/vertex_format.h>
 
 struct Material {
     glm::vec3 kd; // diffuse color
@@ -20,33 +22,293 @@ struct Material {
     float shininess;
 };
 
+// axis aligned box and bounding sphere of a mesh in model space
+struct Bounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float radius;
+
+    static Bounds compute(const Vertex *vertices, std::size_t n_vertices) {
+        Bounds bounds;
+        bounds.min = n_vertices > 0 ? vertices[0].position : glm::vec3(0.0f);
+        bounds.max = bounds.min;
+        for (std::size_t i = 1; i < n_vertices; ++i) {
+            bounds.min = glm::min(bounds.min, vertices[i].position);
+            bounds.max = glm::max(bounds.max, vertices[i].position);
+        }
+
+        // centered on the box, tighter than half its diagonal
+        bounds.center = 0.5f * (bounds.min + bounds.max);
+        float radius_squared = 0.0f;
+        for (std::size_t i = 0; i < n_vertices; ++i) {
+            const glm::vec3 offset = vertices[i].position - bounds.center;
+            radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radius_squared);
+        return bounds;
+    }
+};
+
+// range of a mesh's index buffer holding one level of detail
+struct LodLevel {
+    unsigned int first_index;
+    unsigned int index_count;
+    // largest distance of the simplified surface from the full one, model space units
+    float error;
+};
+
+// std140 layout of MaterialBlock in the fragment shaders
+struct MaterialBlock {
+    glm::vec4 kd;
+    glm::vec4 ks;
+    glm::vec4 ka;
+    float shininess;
+    // units of materialTextures[], -1 without a texture
+    GLint diffuse_texture;
+    GLint specular_texture;
+    float padding;
+};
+
+// uniform buffer binding points shared by all programs
+constexpr GLuint camera_block_binding = 0;
+constexpr GLuint material_block_binding = 1;
+
+// texture units 0..max_material_textures - 1, bound to materialTextures[] once per program;
+// a model binds the textures of all its meshes at once and materials pick theirs by unit,
+// 16 is the minimum GL 3.3 guarantees for GL_MAX_TEXTURE_IMAGE_UNITS
+constexpr int max_material_textures = 16;
+
+// textures bound to units 0, 1, ... at once
+using TextureSet = std::vector<GLuint>;
+
+// CPU side geometry of one mesh, built off the GL thread and consumed by the Mesh constructor
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    Material material;
+    std::vector<unsigned int> indices_of_textures;
+    Bounds bounds;
+    // index ranges of the LODs within the indices, empty when there is only the full mesh
+    std::vector<LodLevel> lods;
+
+    // set instead of the vectors above when the geometry lives in a mapped cache file
+    const Vertex *mapped_vertices = nullptr;
+    std::size_t n_mapped_vertices = 0;
+    const unsigned int *mapped_indices = nullptr;
+    std::size_t n_mapped_indices = 0;
+
+    const Vertex *vertex_data() const {
+        return mapped_vertices ? mapped_vertices : vertices.data();
+    }
+
+    std::size_t vertex_count() const {
+        return mapped_vertices ? n_mapped_vertices : vertices.size();
+    }
+
+    const unsigned int *index_data() const {
+        return mapped_indices ? mapped_indices : indices.data();
+    }
+
+    std::size_t index_count() const {
+        return mapped_indices ? n_mapped_indices : indices.size();
+    }
+};
+
+// owns its GL objects unless it is a range of the model's packed buffers; move-only,
+// the CPU copy of the geometry is optional and only kept when asked for
 class Mesh {
 public:
+    // empty unless the geometry was kept, see vertex_count()
     std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
+    // type and size are always valid, the data only when the geometry was kept
+    IndexBuffer indices;
     Material material;
     std::vector<unsigned int> indices_of_textures;
+    Bounds bounds;
+    // at least one level, the full mesh
+    std::vector<LodLevel> lods;
 
     Mesh(
-        const std::vector<Vertex> &vertices,
-        const std::vector<unsigned int> &indices, 
+        std::vector<Vertex> vertices,
+        const std::vector<unsigned int> &indices,
         const Material &material,
-        const std::vector<unsigned int> indices_of_textures
-    ) : vertices(vertices), indices(indices), material(material),
-        indices_of_textures(indices_of_textures) {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        std::vector<unsigned int> indices_of_textures
+    ) : vertices(std::move(vertices)), indices(indices.data(), indices.size(), this->vertices.size()), material(material),
+        indices_of_textures(std::move(indices_of_textures)),
+        bounds(Bounds::compute(this->vertices.data(), this->vertices.size())),
+        lods{{0, static_cast<unsigned int>(this->indices.size()), 0.0f}},
+        n_vertices(this->vertices.size()) {
+        upload(this->vertices.data(), this->vertices.size());
+    }
 
-        glBindVertexArray(VAO);
+    // mapped geometry is uploaded straight from the mapping, owned geometry is moved in when kept;
+    // with a quantization the vertices are uploaded as CompactVertex, with short_indices
+    // the indices are 16 bit if the mesh is small enough
+    Mesh(MeshData &&data, const VertexQuantization *quantization = nullptr, bool short_indices = true, bool keep_geometry = true) :
+        indices(data.index_data(), data.index_count(), data.vertex_count(), short_indices),
+        material(data.material), indices_of_textures(std::move(data.indices_of_textures)), bounds(data.bounds) {
+        upload(data.vertex_data(), data.vertex_count(), quantization);
+        take_geometry(std::move(data), keep_geometry);
+    }
 
-        // VBO
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    // sub-range of a vertex/index buffer shared by the whole model, the mesh owns no GL objects;
+    // index_offset is in bytes since meshes with 16 and 32 bit indices share the buffer
+    Mesh(MeshData &&data, IndexBuffer &&indices, GLint base_vertex, std::size_t index_offset, bool keep_geometry = true) :
+        indices(std::move(indices)),
+        material(data.material), indices_of_textures(std::move(data.indices_of_textures)), bounds(data.bounds),
+        base_vertex(base_vertex), index_offset(index_offset) {
+        take_geometry(std::move(data), keep_geometry);
+    }
 
-        // EBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+    Mesh(Mesh &&) = default;
+    Mesh &operator=(Mesh &&) = default;
+
+    void destroy() {
+        VBO.reset();
+        EBO.reset();
+        VAO.reset();
+        vertices = {};
+        indices.clear();
+        indices_of_textures.clear();
+        lods.clear();
+        n_vertices = 0;
+    }
+
+    std::size_t vertex_count() const {
+        return n_vertices;
+    }
+
+    // own vertex array, 0 for meshes in a model's packed buffers
+    GLuint get_vertex_array() const {
+        return VAO;
+    }
+
+    // range of this mesh's MaterialBlock, the textures are bound per texture set by the model;
+    // meshes with equal blocks share one range
+    GLuint get_material_buffer() const {
+        return material_UBO;
+    }
+
+    GLintptr get_material_offset() const {
+        return material_offset;
+    }
+
+    // index of the shared range within the model, the material field of DrawKey
+    std::size_t get_material_id() const {
+        return material_id;
+    }
+
+    void set_material(GLuint material_UBO, GLintptr material_offset, std::size_t material_id) {
+        this->material_UBO = material_UBO;
+        this->material_offset = material_offset;
+        this->material_id = material_id;
+    }
+
+    // the first diffuse and specular texture, the only ones the shaders sample
+    std::pair<const Texture*, const Texture*> material_textures(const std::vector<Texture> &textures) const {
+        const Texture *diffuse = nullptr;
+        const Texture *specular = nullptr;
+        for (const auto index : indices_of_textures) {
+            const Texture &texture = textures[index];
+            if (texture.texture_type == TextureType::DIFFUSE && !diffuse) {
+                diffuse = &texture;
+            } else if (texture.texture_type == TextureType::SPECULAR && !specular) {
+                specular = &texture;
+            }
+        }
+        return {diffuse, specular};
+    }
+
+    // resolve textures to units of the given set and fill this mesh's MaterialBlock, done once after
+    // loading; false without changes when the set has no room left for them
+    bool prepare_material(const std::vector<Texture> &textures, TextureSet &set, std::size_t set_index, MaterialBlock &block) {
+        const auto [diffuse, specular] = material_textures(textures);
+        TextureSet extended = set;
+        auto unit_of = [&extended](const Texture *texture) {
+            if (!texture) {
+                return -1;
+            }
+            const auto it = std::find(extended.begin(), extended.end(), texture->id);
+            if (it != extended.end()) {
+                return static_cast<int>(it - extended.begin());
+            }
+            extended.push_back(texture->id);
+            return static_cast<int>(extended.size()) - 1;
+        };
+        const GLint diffuse_unit = unit_of(diffuse);
+        const GLint specular_unit = unit_of(specular);
+        if (extended.size() > static_cast<std::size_t>(max_material_textures)) {
+            return false;
+        }
+        set = std::move(extended);
+        texture_set = set_index;
+
+        block.kd = glm::vec4(material.kd, 1.0f);
+        block.ks = glm::vec4(material.ks, 1.0f);
+        block.ka = glm::vec4(material.ka, 1.0f);
+        block.shininess = material.shininess;
+        block.diffuse_texture = diffuse_unit;
+        block.specular_texture = specular_unit;
+        block.padding = 0.0f;
+
+        shader_features = 0;
+        if (diffuse_unit >= 0) {
+            shader_features |= feature_bit(ShaderFeature::DiffuseTexture);
+        }
+        if (specular_unit >= 0) {
+            shader_features |= feature_bit(ShaderFeature::SpecularTexture);
+        }
+        return true;
+    }
+
+    // the material's part of the shader variant, see ShaderLibrary
+    ShaderFeatures get_shader_features() const {
+        return shader_features;
+    }
+
+    // index of the model's TextureSet this mesh is drawn with
+    std::size_t get_texture_set() const {
+        return texture_set;
+    }
+
+    // true when both meshes can be drawn with the same material state
+    bool same_material(const Mesh &other) const {
+        return material.kd == other.material.kd &&
+            material.ks == other.material.ks &&
+            material.ka == other.material.ka &&
+            material.shininess == other.material.shininess &&
+            indices_of_textures == other.indices_of_textures;
+    }
+
+    GLint get_base_vertex() const {
+        return base_vertex;
+    }
+
+    std::size_t get_index_offset() const {
+        return index_offset;
+    }
+
+    // attribute layout of Vertex or CompactVertex for the currently bound VAO and GL_ARRAY_BUFFER
+    static void set_vertex_layout(bool compact = false) {
+        if (compact) {
+            const GLsizei stride = sizeof(CompactVertex);
+
+            // position, unorm16 inside the quantization box
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, reinterpret_cast<void*>(offsetof(CompactVertex, position)));
+
+            // octahedral normal, snorm16
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, reinterpret_cast<void*>(offsetof(CompactVertex, normal)));
+
+            // texture coords, half float
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offsetof(CompactVertex, tex_coords)));
+            return ;
+        }
 
         // position
         glEnableVertexAttribArray(0);
@@ -59,60 +321,84 @@ public:
         // texture coords
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, tex_coords)));
+    }
 
-        glBindVertexArray(0);
+    // per-instance model matrix at locations 3 to 6 for the currently bound VAO and GL_ARRAY_BUFFER,
+    // the matrices start at offset bytes into the buffer
+    static void set_instance_layout(GLintptr offset = 0) {
+        for (GLuint column = 0; column < 4; ++column) {
+            glEnableVertexAttribArray(instance_matrix_location + column);
+            glVertexAttribPointer(instance_matrix_location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  reinterpret_cast<void*>(offset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(instance_matrix_location + column, 1);
+        }
     }
 
-    void destroy() {
-        glDeleteBuffers(1, &VBO);
-        glDeleteBuffers(1, &EBO);
-        glDeleteVertexArrays(1, &VAO);
-        vertices.clear();
-        indices.clear();
-        indices_of_textures.clear();
+private:
+    static constexpr GLuint instance_matrix_location = 3;
+
+    GLVertexArray VAO;
+    GLBuffer VBO;
+    GLBuffer EBO;
+    std::size_t n_vertices = 0;
+    GLint base_vertex = 0;
+    std::size_t index_offset = 0;
+
+    // owned by the Model
+    GLuint material_UBO = 0;
+    GLintptr material_offset = 0;
+    std::size_t material_id = 0;
+    std::size_t texture_set = 0;
+    ShaderFeatures shader_features = 0;
+
+    void take_geometry(MeshData &&data, bool keep_geometry) {
+        // the indices were already converted to an IndexBuffer
+        n_vertices = data.vertex_count();
+        if (!keep_geometry) {
+            indices.release();
+            data.vertices = {};
+        } else if (data.mapped_vertices) {
+            vertices.assign(data.mapped_vertices, data.mapped_vertices + data.n_mapped_vertices);
+        } else {
+            vertices = std::move(data.vertices);
+        }
+        data.indices = {};
+        if (data.lods.empty()) {
+            lods = {{0, static_cast<unsigned int>(indices.size()), 0.0f}};
+        } else {
+            lods = std::move(data.lods);
+        }
     }
 
-    void draw(const Shader &shader, const std::vector<Texture> &textures) const {
-        shader.set_uniform("kd", material.kd);
-        shader.set_uniform("ks", material.ks);
-        shader.set_uniform("ka", material.ka);
-        shader.set_uniform("shininess", material.shininess);
-
-        std::size_t n_diffuse = 0;
-        std::size_t n_specular = 0;
-        for (std::size_t i = 0; i < indices_of_textures.size(); ++i) {
-            const Texture &texture = textures[indices_of_textures[i]];
-            const int texture_unit_number = i;
-
-            switch (texture.texture_type) {
-                case TextureType::DIFFUSE: {
-                    const std::string uniform_name = "diffuseTextures[" + std::to_string(n_diffuse) + "]";
-                    shader.set_uniform_texture(uniform_name, texture.id, texture_unit_number);
-                    n_diffuse++;
-                    break;
-                }
-                case TextureType::SPECULAR: {
-                    const std::string uniform_name = "specularTextures[" + std::to_string(n_specular) + "]";
-                    shader.set_uniform_texture(uniform_name, texture.id, texture_unit_number);
-                    n_specular++;
-                    break;
-                }
+    void upload(
+        const Vertex *vertex_data,
+        std::size_t n_vertices,
+        const VertexQuantization *quantization = nullptr
+    ) {
+        VAO.create();
+        VBO.create();
+        EBO.create();
+
+        glBindVertexArray(VAO);
+
+        // VBO
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (quantization) {
+            std::vector<CompactVertex> compact(n_vertices);
+            for (std::size_t i = 0; i < n_vertices; ++i) {
+                compact[i] = quantization->compress(vertex_data[i]);
             }
+            glBufferData(GL_ARRAY_BUFFER, n_vertices * sizeof(CompactVertex), compact.data(), GL_STATIC_DRAW);
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, n_vertices * sizeof(Vertex), vertex_data, GL_STATIC_DRAW);
         }
 
-        shader.set_uniform("hasDiffuseTextures", n_diffuse > 0);
-        shader.set_uniform("hasSpecularTextures", n_specular > 0);
+        // EBO
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size_in_bytes(), indices.data(), GL_STATIC_DRAW);
+
+        set_vertex_layout(quantization != nullptr);
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        shader.activate();
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        shader.deactivate();
         glBindVertexArray(0);
     }
-
-private:
-    GLuint VAO;
-    GLuint VBO;
-    GLuint EBO;
 };
\ No newline at end of file
@@ -0,0 +1,429 @@
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <zmv/hash.h>
+#include <zmv/mapped_file.h>
+#include <zmv/mesh.h>
+#include <zmv/model_data.h>
+#include <zmv/obj_loader.h>
+#include <zmv/texture.h>
+
+// binary cache of imported models, keyed by source path + mtime + size + import and processing flags;
+// the material libraries an OBJ file references (mtllib) are recorded with their size and mtime
+// too, and an entry is stale when any of them changed
+//
+// layout: header | dependency table | texture table | mesh records | per-mesh vertex, index, texture index and LOD arrays
+// every array starts on a 16 byte boundary so that it can be handed to glBufferData directly
+class MeshCache {
+public:
+    MeshCache(const std::string &cache_directory = ".zmv_cache") :
+        cache_directory(cache_directory) { }
+
+    // on a hit the returned meshes point into the mapped cache file held by ModelData::mapping
+    std::optional<ModelData> load(const std::string &filepath, unsigned int import_flags, unsigned int processing_flags) const {
+        const auto key = make_key(filepath, import_flags, processing_flags);
+        if (!key) {
+            return std::nullopt;
+        }
+
+        ModelData cache;
+        if (!cache.mapping.open(cache_filepath(*key))) {
+            return std::nullopt;
+        }
+        cache.filepath = filepath;
+        cache.from_cache = true;
+
+        const unsigned char *bytes = cache.mapping.data();
+        const std::size_t n_bytes = cache.mapping.size();
+
+        Header header;
+        if (n_bytes < sizeof(Header)) {
+            return std::nullopt;
+        }
+        std::memcpy(&header, bytes, sizeof(Header));
+        if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+            header.version != version ||
+            header.key != key->digest ||
+            header.source_size != key->source_size ||
+            header.source_mtime != key->source_mtime ||
+            header.import_flags != import_flags ||
+            header.processing_flags != processing_flags ||
+            header.file_size != n_bytes) {
+            std::cerr << "[MeshCache] stale cache entry for " << filepath << std::endl;
+            return std::nullopt;
+        }
+
+        // dependency table, compared with the files as they are now
+        std::size_t offset = sizeof(Header);
+        std::vector<Dependency> dependencies;
+        for (std::uint32_t i = 0; i < header.n_dependencies; ++i) {
+            if (offset + sizeof(DependencyRecord) > n_bytes) {
+                return std::nullopt;
+            }
+            DependencyRecord record;
+            std::memcpy(&record, bytes + offset, sizeof(DependencyRecord));
+            offset += sizeof(DependencyRecord);
+            if (offset + record.path_length > n_bytes) {
+                return std::nullopt;
+            }
+            const char *path = reinterpret_cast<const char*>(bytes + offset);
+            dependencies.push_back(stamp(std::string(path, record.path_length)));
+            offset = align(offset + record.path_length);
+        }
+        if (header.dependency_key != dependency_key(key->digest, dependencies)) {
+            std::cerr << "[MeshCache] stale cache entry for " << filepath << " (material library changed)" << std::endl;
+            return std::nullopt;
+        }
+
+        // texture table
+        for (std::uint32_t i = 0; i < header.n_textures; ++i) {
+            if (offset + sizeof(TextureRecord) > n_bytes) {
+                return std::nullopt;
+            }
+            TextureRecord record;
+            std::memcpy(&record, bytes + offset, sizeof(TextureRecord));
+            offset += sizeof(TextureRecord);
+            if (offset + record.path_length > n_bytes) {
+                return std::nullopt;
+            }
+            const char *path = reinterpret_cast<const char*>(bytes + offset);
+            TextureData texture;
+            texture.filepath.assign(path, record.path_length);
+            texture.texture_type = static_cast<TextureType>(record.texture_type);
+            cache.textures.push_back(std::move(texture));
+            offset = align(offset + record.path_length);
+        }
+
+        // meshes
+        for (std::uint32_t i = 0; i < header.n_meshes; ++i) {
+            if (offset + sizeof(MeshRecord) > n_bytes) {
+                return std::nullopt;
+            }
+            MeshRecord record;
+            std::memcpy(&record, bytes + offset, sizeof(MeshRecord));
+            offset += sizeof(MeshRecord);
+            if (record.vertex_offset + record.n_vertices * sizeof(Vertex) > n_bytes ||
+                record.index_offset + record.n_indices * sizeof(unsigned int) > n_bytes ||
+                record.texture_index_offset + record.n_texture_indices * sizeof(unsigned int) > n_bytes ||
+                record.lod_offset + record.n_lods * sizeof(LodLevel) > n_bytes) {
+                return std::nullopt;
+            }
+
+            MeshData mesh;
+            mesh.mapped_vertices = reinterpret_cast<const Vertex*>(bytes + record.vertex_offset);
+            mesh.n_mapped_vertices = record.n_vertices;
+            mesh.mapped_indices = reinterpret_cast<const unsigned int*>(bytes + record.index_offset);
+            mesh.n_mapped_indices = record.n_indices;
+            mesh.material = record.material;
+            mesh.bounds = record.bounds;
+            const unsigned int *indices_of_textures = reinterpret_cast<const unsigned int*>(bytes + record.texture_index_offset);
+            mesh.indices_of_textures.assign(indices_of_textures, indices_of_textures + record.n_texture_indices);
+            const LodLevel *lods = reinterpret_cast<const LodLevel*>(bytes + record.lod_offset);
+            mesh.lods.assign(lods, lods + record.n_lods);
+            for (const auto &lod : mesh.lods) {
+                if (static_cast<std::size_t>(lod.first_index) + lod.index_count > record.n_indices) {
+                    return std::nullopt;
+                }
+            }
+            cache.meshes.push_back(std::move(mesh));
+        }
+
+        return cache;
+    }
+
+    void store(
+        const std::string &filepath,
+        unsigned int import_flags,
+        unsigned int processing_flags,
+        const ModelData &model
+    ) const {
+        const std::vector<MeshData> &meshes = model.meshes;
+        const std::vector<TextureData> &textures = model.textures;
+        const auto key = make_key(filepath, import_flags, processing_flags);
+        if (!key) {
+            return ;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(cache_directory, ec);
+        const std::vector<Dependency> dependencies = find_dependencies(filepath);
+
+        // compute layout
+        std::size_t offset = sizeof(Header);
+        for (const auto &dependency : dependencies) {
+            offset = align(offset + sizeof(DependencyRecord) + dependency.path.size());
+        }
+        for (const auto &texture : textures) {
+            offset = align(offset + sizeof(TextureRecord) + texture.filepath.size());
+        }
+        std::vector<MeshRecord> records(meshes.size());
+        offset += records.size() * sizeof(MeshRecord);
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            MeshRecord &record = records[i];
+            record.material = meshes[i].material;
+            record.bounds = meshes[i].bounds;
+
+            offset = align(offset);
+            record.vertex_offset = offset;
+            record.n_vertices = meshes[i].vertex_count();
+            offset += record.n_vertices * sizeof(Vertex);
+
+            offset = align(offset);
+            record.index_offset = offset;
+            record.n_indices = meshes[i].index_count();
+            offset += record.n_indices * sizeof(unsigned int);
+
+            offset = align(offset);
+            record.texture_index_offset = offset;
+            record.n_texture_indices = static_cast<std::uint32_t>(meshes[i].indices_of_textures.size());
+            offset += record.n_texture_indices * sizeof(unsigned int);
+
+            offset = align(offset);
+            record.lod_offset = offset;
+            record.n_lods = static_cast<std::uint32_t>(meshes[i].lods.size());
+            offset += record.n_lods * sizeof(LodLevel);
+        }
+
+        Header header;
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.n_meshes = static_cast<std::uint32_t>(meshes.size());
+        header.n_textures = static_cast<std::uint32_t>(textures.size());
+        header.n_dependencies = static_cast<std::uint32_t>(dependencies.size());
+        header.import_flags = import_flags;
+        header.processing_flags = processing_flags;
+        header.key = key->digest;
+        header.source_size = key->source_size;
+        header.source_mtime = key->source_mtime;
+        header.dependency_key = dependency_key(key->digest, dependencies);
+        header.file_size = offset;
+
+        // write to a temporary file first so that a crash never leaves a truncated entry behind
+        const std::string final_path = cache_filepath(*key);
+        const std::string temporary_path = final_path + ".tmp";
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[MeshCache] failed to open " << temporary_path << std::endl;
+            return ;
+        }
+
+        std::size_t position = 0;
+        auto write = [&](const void *data, std::size_t size) {
+            file.write(static_cast<const char*>(data), size);
+            position += size;
+        };
+        auto pad = [&]() {
+            static const char zeros[alignment] = {};
+            write(zeros, align(position) - position);
+        };
+
+        write(&header, sizeof(Header));
+        for (const auto &dependency : dependencies) {
+            DependencyRecord record;
+            record.path_length = static_cast<std::uint32_t>(dependency.path.size());
+            write(&record, sizeof(DependencyRecord));
+            write(dependency.path.data(), dependency.path.size());
+            pad();
+        }
+        for (const auto &texture : textures) {
+            TextureRecord record;
+            record.texture_type = static_cast<std::uint32_t>(texture.texture_type);
+            record.path_length = static_cast<std::uint32_t>(texture.filepath.size());
+            write(&record, sizeof(TextureRecord));
+            write(texture.filepath.data(), texture.filepath.size());
+            pad();
+        }
+        write(records.data(), records.size() * sizeof(MeshRecord));
+        for (const auto &mesh : meshes) {
+            pad();
+            write(mesh.vertex_data(), mesh.vertex_count() * sizeof(Vertex));
+            pad();
+            write(mesh.index_data(), mesh.index_count() * sizeof(unsigned int));
+            pad();
+            write(mesh.indices_of_textures.data(), mesh.indices_of_textures.size() * sizeof(unsigned int));
+            pad();
+            write(mesh.lods.data(), mesh.lods.size() * sizeof(LodLevel));
+        }
+        file.close();
+
+        if (!file) {
+            std::cerr << "[MeshCache] failed to write " << temporary_path << std::endl;
+            std::filesystem::remove(temporary_path, ec);
+            return ;
+        }
+        std::filesystem::rename(temporary_path, final_path, ec);
+        if (ec) {
+            std::cerr << "[MeshCache] failed to write " << final_path << ": " << ec.message() << std::endl;
+            std::filesystem::remove(temporary_path, ec);
+        }
+    }
+
+private:
+    static constexpr char magic[4] = {'Z', 'M', 'V', 'M'};
+    static constexpr std::uint32_t version = 4;
+    static constexpr std::size_t alignment = 16;
+
+    static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex is written to the cache as raw bytes");
+    static_assert(std::is_trivially_copyable<Material>::value, "Material is written to the cache as raw bytes");
+    static_assert(std::is_trivially_copyable<Bounds>::value, "Bounds is written to the cache as raw bytes");
+    static_assert(std::is_trivially_copyable<LodLevel>::value, "LodLevel is written to the cache as raw bytes");
+
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t n_meshes;
+        std::uint32_t n_textures;
+        std::uint32_t import_flags;
+        std::uint32_t processing_flags;
+        std::uint32_t n_dependencies;
+        std::uint32_t padding = 0;
+        std::uint64_t key;
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+        // key combined with the path, size and mtime of every dependency
+        std::uint64_t dependency_key;
+        std::uint64_t file_size;
+    };
+
+    struct DependencyRecord {
+        std::uint32_t path_length;
+        std::uint32_t padding = 0;
+    };
+
+    struct TextureRecord {
+        std::uint32_t texture_type;
+        std::uint32_t path_length;
+    };
+
+    struct MeshRecord {
+        std::uint64_t vertex_offset;
+        std::uint64_t n_vertices;
+        std::uint64_t index_offset;
+        std::uint64_t n_indices;
+        std::uint64_t texture_index_offset;
+        std::uint32_t n_texture_indices;
+        Material material;
+        Bounds bounds;
+        std::uint64_t lod_offset;
+        std::uint32_t n_lods;
+    };
+
+    struct Key {
+        std::uint64_t digest;
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+    };
+
+    // a file the import read besides the source; a missing one has size and mtime -1, so that
+    // creating it later makes the entry stale as well
+    struct Dependency {
+        std::string path;
+        std::int64_t size;
+        std::int64_t mtime;
+    };
+
+    std::string cache_directory;
+
+    static std::size_t align(std::size_t offset) {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    std::optional<Key> make_key(const std::string &filepath, unsigned int import_flags, unsigned int processing_flags) const {
+        std::error_code ec;
+        const std::filesystem::path canonical_path = std::filesystem::canonical(filepath, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        const auto source_size = std::filesystem::file_size(canonical_path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        const auto source_mtime = std::filesystem::last_write_time(canonical_path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+
+        Key key;
+        key.source_size = source_size;
+        key.source_mtime = static_cast<std::int64_t>(source_mtime.time_since_epoch().count());
+        key.digest = Hash()
+            .add(canonical_path.generic_string())
+            .add(key.source_size)
+            .add(key.source_mtime)
+            .add(import_flags)
+            .add(processing_flags)
+            .add(version)
+            .digest();
+        return key;
+    }
+
+    static Dependency stamp(const std::string &path) {
+        Dependency dependency{path, -1, -1};
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            return dependency;
+        }
+        const auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return dependency;
+        }
+        dependency.size = static_cast<std::int64_t>(size);
+        dependency.mtime = static_cast<std::int64_t>(mtime.time_since_epoch().count());
+        return dependency;
+    }
+
+    static std::uint64_t dependency_key(std::uint64_t digest, const std::vector<Dependency> &dependencies) {
+        Hash hash;
+        hash.add(digest);
+        for (const auto &dependency : dependencies) {
+            hash.add(dependency.path).add(dependency.size).add(dependency.mtime);
+        }
+        return hash.digest();
+    }
+
+    // material libraries of an OBJ file, split and resolved relative to its directory like
+    // ObjLoader does; only read when an entry is written
+    static std::vector<Dependency> find_dependencies(const std::string &filepath) {
+        std::vector<Dependency> dependencies;
+        const std::filesystem::path path(filepath);
+        std::string extension = path.extension().string();
+        for (char &c : extension) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        if (extension != ".obj") {
+            return dependencies;
+        }
+        std::ifstream file(filepath);
+        std::string line;
+        while (std::getline(file, line)) {
+            const std::size_t begin = line.find_first_not_of(" \t");
+            if (begin == std::string::npos || line.compare(begin, 6, "mtllib") != 0) {
+                continue;
+            }
+            if (line.size() == begin + 6 || (line[begin + 6] != ' ' && line[begin + 6] != '\t')) {
+                continue;
+            }
+            for (const auto &name : ObjLoader::split_material_libraries(line.substr(begin + 6))) {
+                dependencies.push_back(stamp((path.parent_path() / name).generic_string()));
+            }
+        }
+        return dependencies;
+    }
+
+    std::string cache_filepath(const Key &key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.zmvmesh", static_cast<unsigned long long>(key.digest));
+        return (std::filesystem::path(cache_directory) / name).string();
+    }
+};
@@ -0,0 +1,362 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <zmv/mesh.h>
+
+// import time reordering of index and vertex buffers for the post-transform vertex cache,
+// vertex fetch locality and, optionally, overdraw; applied to every LOD range of a mesh
+class MeshOptimizer {
+public:
+    // post-transform cache efficiency of an index buffer
+    struct CacheStatistics {
+        float acmr = 0.0f; // average cache misses per triangle, 0.5 is ideal for a regular grid
+        float atvr = 0.0f; // average transformations per vertex, 1.0 is ideal
+    };
+
+    // FIFO size used to evaluate the result, close to what current hardware effectively has
+    static constexpr std::size_t simulated_cache_size = 16;
+
+    static CacheStatistics analyze(const unsigned int *indices, std::size_t n_indices, std::size_t n_vertices) {
+        CacheStatistics statistics;
+        if (n_indices == 0) {
+            return statistics;
+        }
+
+        // timestamps instead of an explicit FIFO: a vertex is in the cache if it was loaded in the last N misses
+        std::vector<std::size_t> loaded_at(n_vertices, 0);
+        std::vector<bool> used(n_vertices, false);
+        std::size_t n_misses = 0;
+        std::size_t n_used = 0;
+        for (std::size_t i = 0; i < n_indices; ++i) {
+            const unsigned int index = indices[i];
+            if (!used[index]) {
+                used[index] = true;
+                n_used++;
+            }
+            if (loaded_at[index] == 0 || n_misses - loaded_at[index] >= simulated_cache_size) {
+                n_misses++;
+                loaded_at[index] = n_misses;
+            }
+        }
+        statistics.acmr = static_cast<float>(n_misses) / (n_indices / 3);
+        statistics.atvr = static_cast<float>(n_misses) / n_used;
+        return statistics;
+    }
+
+    // reorders triangles of every LOD range and then the vertices, returns the statistics of the
+    // full detail range before and after
+    static std::pair<CacheStatistics, CacheStatistics> optimize(MeshData &mesh, bool optimize_overdraw) {
+        const std::size_t n_vertices = mesh.vertices.size();
+        const LodLevel full = mesh.lods.empty() ?
+            LodLevel{0, static_cast<unsigned int>(mesh.indices.size()), 0.0f} : mesh.lods[0];
+
+        std::pair<CacheStatistics, CacheStatistics> statistics;
+        statistics.first = analyze(mesh.indices.data() + full.first_index, full.index_count, n_vertices);
+
+        auto optimize_range = [&](const LodLevel &lod) {
+            unsigned int *indices = mesh.indices.data() + lod.first_index;
+            optimize_vertex_cache(indices, lod.index_count, n_vertices);
+            if (optimize_overdraw) {
+                sort_clusters(indices, lod.index_count, mesh.vertices.data(), n_vertices);
+            }
+        };
+        if (mesh.lods.empty()) {
+            optimize_range(full);
+        }
+        for (const auto &lod : mesh.lods) {
+            optimize_range(lod);
+        }
+        optimize_vertex_fetch(mesh);
+
+        statistics.second = analyze(mesh.indices.data() + full.first_index, full.index_count, n_vertices);
+        return statistics;
+    }
+
+    // Forsyth's linear-speed vertex cache optimization: repeatedly emit the triangle with the
+    // highest score, where vertices score for being recently used and for having few triangles left
+    static void optimize_vertex_cache(unsigned int *indices, std::size_t n_indices, std::size_t n_vertices) {
+        const std::size_t n_triangles = n_indices / 3;
+        if (n_triangles == 0) {
+            return ;
+        }
+
+        // triangles around every vertex in compressed rows, emitted ones are removed by swapping
+        std::vector<unsigned int> offsets(n_vertices + 1, 0);
+        for (std::size_t i = 0; i < n_indices; ++i) {
+            offsets[indices[i] + 1]++;
+        }
+        for (std::size_t i = 0; i < n_vertices; ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+        std::vector<unsigned int> n_live(n_vertices, 0);
+        std::vector<unsigned int> adjacency(n_indices);
+        for (std::size_t i = 0; i < n_indices; ++i) {
+            const unsigned int vertex = indices[i];
+            adjacency[offsets[vertex] + n_live[vertex]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        std::vector<float> vertex_score(n_vertices);
+        for (std::size_t i = 0; i < n_vertices; ++i) {
+            vertex_score[i] = score(-1, n_live[i]);
+        }
+        std::vector<float> triangle_score(n_triangles);
+        for (std::size_t t = 0; t < n_triangles; ++t) {
+            triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+        }
+
+        std::vector<unsigned int> result;
+        result.reserve(n_indices);
+        std::vector<bool> emitted(n_triangles, false);
+        std::vector<unsigned int> cache;
+        std::vector<unsigned int> next_cache;
+        cache.reserve(forsyth_cache_size + 3);
+        next_cache.reserve(forsyth_cache_size + 3);
+
+        std::size_t scan_position = 0;
+        std::size_t best = next_remaining_triangle(emitted, scan_position);
+        while (best != n_triangles) {
+            emitted[best] = true;
+            const unsigned int *triangle = &indices[best * 3];
+            result.insert(result.end(), triangle, triangle + 3);
+
+            // the emitted triangle's vertices move to the front of the LRU cache
+            next_cache.assign(triangle, triangle + 3);
+            for (const auto vertex : cache) {
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                    next_cache.push_back(vertex);
+                }
+            }
+            for (std::size_t k = 0; k < 3; ++k) {
+                const unsigned int vertex = triangle[k];
+                unsigned int *begin = adjacency.data() + offsets[vertex];
+                unsigned int *end = begin + n_live[vertex];
+                // degenerate triangles list the same vertex twice
+                unsigned int *found = std::find(begin, end, static_cast<unsigned int>(best));
+                if (found != end) {
+                    *found = *(end - 1);
+                    n_live[vertex]--;
+                }
+            }
+
+            // rescore the vertices in the cache, those that fell out of it included,
+            // and the triangles around them; the best of those is most likely the best overall
+            float best_score = -1.0f;
+            best = n_triangles;
+            for (std::size_t i = 0; i < next_cache.size(); ++i) {
+                const unsigned int vertex = next_cache[i];
+                const int position = i < forsyth_cache_size ? static_cast<int>(i) : -1;
+                const float delta = score(position, n_live[vertex]) - vertex_score[vertex];
+                vertex_score[vertex] += delta;
+                for (unsigned int j = offsets[vertex]; j < offsets[vertex] + n_live[vertex]; ++j) {
+                    const unsigned int t = adjacency[j];
+                    triangle_score[t] += delta;
+                }
+            }
+            for (std::size_t i = 0; i < std::min(next_cache.size(), forsyth_cache_size); ++i) {
+                const unsigned int vertex = next_cache[i];
+                for (unsigned int j = offsets[vertex]; j < offsets[vertex] + n_live[vertex]; ++j) {
+                    const unsigned int t = adjacency[j];
+                    if (triangle_score[t] > best_score) {
+                        best_score = triangle_score[t];
+                        best = t;
+                    }
+                }
+            }
+            if (next_cache.size() > forsyth_cache_size) {
+                next_cache.resize(forsyth_cache_size);
+            }
+            std::swap(cache, next_cache);
+
+            // nothing left around the cache, continue with any remaining triangle
+            if (best == n_triangles) {
+                best = next_remaining_triangle(emitted, scan_position);
+            }
+        }
+
+        std::copy(result.begin(), result.end(), indices);
+    }
+
+    // splits the cache optimized triangle order into clusters at points where the cache mostly restarts,
+    // then draws clusters facing away from the mesh center first so they occlude the ones behind
+    static void sort_clusters(unsigned int *indices, std::size_t n_indices, const Vertex *vertices, std::size_t n_vertices) {
+        const std::size_t n_triangles = n_indices / 3;
+        if (n_triangles < min_cluster_triangles * 2) {
+            return ;
+        }
+
+        glm::vec3 mesh_center(0.0f);
+        for (std::size_t i = 0; i < n_indices; ++i) {
+            mesh_center += vertices[indices[i]].position;
+        }
+        mesh_center /= static_cast<float>(n_indices);
+
+        // a triangle with more than one cache miss starts a new run, e.g. where the optimizer turned around
+        std::vector<std::size_t> cluster_begin;
+        std::vector<std::size_t> loaded_at(n_vertices, 0);
+        std::size_t n_misses = 0;
+        for (std::size_t t = 0; t < n_triangles; ++t) {
+            std::size_t triangle_misses = 0;
+            for (std::size_t k = 0; k < 3; ++k) {
+                const unsigned int index = indices[t * 3 + k];
+                if (loaded_at[index] == 0 || n_misses - loaded_at[index] >= simulated_cache_size) {
+                    n_misses++;
+                    loaded_at[index] = n_misses;
+                    triangle_misses++;
+                }
+            }
+            if (cluster_begin.empty() || (triangle_misses >= 2 && t - cluster_begin.back() >= min_cluster_triangles)) {
+                cluster_begin.push_back(t);
+            }
+        }
+        cluster_begin.push_back(n_triangles);
+
+        struct Cluster {
+            std::size_t begin;
+            std::size_t end;
+            float key;
+        };
+        std::vector<Cluster> clusters;
+        for (std::size_t c = 0; c + 1 < cluster_begin.size(); ++c) {
+            glm::vec3 center(0.0f);
+            glm::vec3 normal(0.0f);
+            float total_area = 0.0f;
+            for (std::size_t t = cluster_begin[c]; t < cluster_begin[c + 1]; ++t) {
+                const glm::vec3 &p0 = vertices[indices[t * 3]].position;
+                const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+                const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+                // area weighted
+                const glm::vec3 area_normal = glm::cross(p1 - p0, p2 - p0);
+                const float area = glm::length(area_normal);
+                center += (p0 + p1 + p2) * (area / 3.0f);
+                normal += area_normal;
+                total_area += area;
+            }
+            const float normal_length = glm::length(normal);
+            float key = 0.0f;
+            if (total_area > 0.0f && normal_length > 0.0f) {
+                key = glm::dot(center / total_area - mesh_center, normal / normal_length);
+            }
+            clusters.push_back({cluster_begin[c], cluster_begin[c + 1], key});
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) {
+            return a.key > b.key;
+        });
+
+        std::vector<unsigned int> result;
+        result.reserve(n_indices);
+        for (const auto &cluster : clusters) {
+            result.insert(result.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+        }
+        std::copy(result.begin(), result.end(), indices);
+    }
+
+    // renumbers vertices in order of first use so that vertex fetches walk the buffer linearly,
+    // the full detail range comes first; unreferenced vertices are kept at the end
+    static void optimize_vertex_fetch(MeshData &mesh) {
+        const std::size_t n_vertices = mesh.vertices.size();
+        const unsigned int unassigned = ~0u;
+        std::vector<unsigned int> remap(n_vertices, unassigned);
+        std::vector<Vertex> vertices;
+        vertices.reserve(n_vertices);
+        for (auto &index : mesh.indices) {
+            if (remap[index] == unassigned) {
+                remap[index] = static_cast<unsigned int>(vertices.size());
+                vertices.push_back(mesh.vertices[index]);
+            }
+            index = remap[index];
+        }
+        for (std::size_t i = 0; i < n_vertices; ++i) {
+            if (remap[i] == unassigned) {
+                vertices.push_back(mesh.vertices[i]);
+            }
+        }
+        mesh.vertices = std::move(vertices);
+    }
+
+    // splits a mesh into parts of at most max_vertices vertices each, keeping the triangle order;
+    // runs before LODs are generated, small meshes are returned as they are
+    static std::vector<MeshData> split(MeshData &&mesh, std::size_t max_vertices) {
+        std::vector<MeshData> parts;
+        if (mesh.vertices.size() <= max_vertices) {
+            parts.push_back(std::move(mesh));
+            return parts;
+        }
+
+        // remap[v] is the vertex's index in the part that last used it, part_of[v] that part
+        const unsigned int unassigned = ~0u;
+        std::vector<unsigned int> remap(mesh.vertices.size(), unassigned);
+        std::vector<unsigned int> part_of(mesh.vertices.size(), unassigned);
+        auto start_part = [&]() {
+            parts.emplace_back();
+            parts.back().material = mesh.material;
+            parts.back().indices_of_textures = mesh.indices_of_textures;
+        };
+        start_part();
+
+        for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const unsigned int part = static_cast<unsigned int>(parts.size() - 1);
+            std::size_t n_new = 0;
+            for (std::size_t k = 0; k < 3; ++k) {
+                n_new += part_of[mesh.indices[i + k]] != part;
+            }
+            if (parts.back().vertices.size() + n_new > max_vertices) {
+                start_part();
+            }
+
+            MeshData &current = parts.back();
+            const unsigned int current_part = static_cast<unsigned int>(parts.size() - 1);
+            for (std::size_t k = 0; k < 3; ++k) {
+                const unsigned int index = mesh.indices[i + k];
+                if (part_of[index] != current_part) {
+                    part_of[index] = current_part;
+                    remap[index] = static_cast<unsigned int>(current.vertices.size());
+                    current.vertices.push_back(mesh.vertices[index]);
+                }
+                current.indices.push_back(remap[index]);
+            }
+        }
+
+        for (auto &part : parts) {
+            part.bounds = Bounds::compute(part.vertices.data(), part.vertices.size());
+        }
+        return parts;
+    }
+
+private:
+    static constexpr std::size_t forsyth_cache_size = 32;
+    static constexpr std::size_t min_cluster_triangles = 64;
+
+    static float score(int cache_position, unsigned int n_live_triangles) {
+        if (n_live_triangles == 0) {
+            // no triangles left, never selected
+            return -1.0f;
+        }
+
+        float result = 0.0f;
+        if (cache_position >= 0) {
+            if (cache_position < 3) {
+                // used by the last triangle, penalized so that strips do not turn back on themselves
+                result = 0.75f;
+            } else {
+                const float scale = 1.0f / (forsyth_cache_size - 3);
+                result = std::pow(1.0f - (cache_position - 3) * scale, 1.5f);
+            }
+        }
+        // vertices with few triangles left are finished first so they can leave the cache
+        result += 2.0f * std::pow(static_cast<float>(n_live_triangles), -0.5f);
+        return result;
+    }
+
+    // a full scan for the best score is too slow for large meshes, the first remaining triangle is good enough
+    static std::size_t next_remaining_triangle(const std::vector<bool> &emitted, std::size_t &scan_position) {
+        while (scan_position < emitted.size() && emitted[scan_position]) {
+            scan_position++;
+        }
+        return scan_position;
+    }
+};
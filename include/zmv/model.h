@@ -1,6 +1,14 @@
 #pragma once
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -13,53 +21,428 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <zmv/draw_queue.h>
+#include <zmv/frame_stats.h>
+#include <zmv/frustum.h>
+#include <zmv/gl_object.h>
+#include <zmv/lod_selector.h>
+#include <zmv/memory_usage.h>
 #include <zmv/mesh.h>
-#include <zmv/shader.h>
+#include <zmv/mesh_cache.h>
+#include <zmv/mesh_optimizer.h>
+#include <zmv/model_data.h>
+#include <zmv/obj_loader.h>
+#include <zmv/profiler.h>
+#include <zmv/shader_library.h>
+#include <zmv/simplifier.h>
 #include <zmv/texture.h>
+#include <zmv/texture_cache.h>
+#include <zmv/thread_pool.h>
 
 class Model {
 public:
     Model() { }
-    Model(const std::string& filepath) { 
-        load_model(filepath);
+    Model(const std::string& filepath, const LoadOptions &options = LoadOptions()) { 
+        load_model(filepath, options);
     }
 
     operator bool() const {
         return meshes.size() > 0;
     }
 
-    void load_model(const std::string &filepath) {
-        Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(filepath, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+    // synchronous load, see ModelLoader for the background version
+    void load_model(const std::string &filepath, const LoadOptions &options = LoadOptions()) {
+        std::optional<ModelData> data = import_model(filepath, options);
+        if (!data) {
+            return ;
+        }
+        begin_upload(*data, options);
+
+        // decode in parallel, textures that are already resident are skipped
+        std::vector<std::future<void>> prepared;
+        for (auto &texture : data->textures) {
+            prepared.push_back(ThreadPool::instance().submit([&texture] {
+                TextureCache::instance().prepare(texture);
+            }));
+        }
+        for (std::size_t i = 0; i < prepared.size(); ++i) {
+            prepared[i].wait();
+            add_texture(data->textures[i]);
+        }
+        for (auto &mesh : data->meshes) {
+            add_mesh(std::move(mesh));
+        }
+        end_upload();
+        print_info(*data);
+    }
+
+    // parse a model into CPU side data without touching GL, safe to call from a worker thread
+    static std::optional<ModelData> import_model(const std::string &filepath, const LoadOptions &options = LoadOptions()) {
+        const auto start = std::chrono::steady_clock::now();
+
+        // reuse the binary cache when the source has not changed since it was written
+        const MeshCache mesh_cache;
+        const unsigned int processing_flags = options.processing_flags();
+        std::optional<ModelData> data = mesh_cache.load(filepath, import_flags, processing_flags);
+        if (!data) {
+            const auto parse_start = std::chrono::steady_clock::now();
+            const std::filesystem::path ps(filepath);
+            std::string extension = ps.extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+                return static_cast<char>(std::tolower(c));
+            });
+            if (options.fast_obj && extension == ".obj") {
+                data = ObjLoader::load(filepath);
+                if (data) {
+                    data->importer = "obj loader";
+                }
+            }
+
+            // every other format, and OBJ files the fast path cannot read
+            if (!data) {
+                Assimp::Importer importer;
+                const aiScene *scene = importer.ReadFile(filepath, import_flags);
+
+                if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+                    std::cerr << "[Assimp]" << importer.GetErrorString() << std::endl;
+                    return std::nullopt;
+                }
+
+                data.emplace();
+                data->filepath = filepath;
+                data->importer = "assimp";
+                data->meshes.reserve(scene->mNumMeshes);
+
+                // process scene graph 
+                process_node(scene->mRootNode, scene, ps.parent_path().string(), *data);
+            }
+            const std::chrono::duration<double, std::milli> parse_time = std::chrono::steady_clock::now() - parse_start;
+            data->parse_milliseconds = parse_time.count();
+
+            if (options.short_indices) {
+                std::vector<MeshData> meshes;
+                for (auto &mesh : data->meshes) {
+                    for (auto &part : MeshOptimizer::split(std::move(mesh), IndexBuffer::max_short_vertices)) {
+                        meshes.push_back(std::move(part));
+                    }
+                }
+                data->meshes = std::move(meshes);
+            }
+            if (options.generate_lods) {
+                for (auto &mesh : data->meshes) {
+                    Simplifier::generate_lods(mesh);
+                }
+            }
+            if (options.optimize_vertex_cache) {
+                for (auto &mesh : data->meshes) {
+                    data->cache_statistics.push_back(MeshOptimizer::optimize(mesh, options.optimize_overdraw));
+                }
+            }
 
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-            std::cerr << "[Assimp]" << importer.GetErrorString() << std::endl;
+            mesh_cache.store(filepath, import_flags, processing_flags, *data);
+        }
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        data->import_milliseconds = elapsed.count();
+        return data;
+    }
+
+    // GL side of loading: begin_upload, add_texture/add_mesh for every item, end_upload
+    void begin_upload(const ModelData &data, const LoadOptions &options) {
+        packed = options.packed_geometry;
+        compact = options.compact_vertices;
+        short_indices = options.short_indices;
+        keep_geometry = options.keep_cpu_geometry;
+        meshes.reserve(data.meshes.size());
+        n_vertex_bytes = 0;
+        n_full_vertex_bytes = 0;
+        n_index_bytes = 0;
+        n_full_index_bytes = 0;
+
+        // one quantization box for the whole model, so meshes sharing a multi-draw share the decode uniforms
+        quantization = VertexQuantization();
+        if (compact && !data.meshes.empty()) {
+            glm::vec3 min = data.meshes[0].bounds.min;
+            glm::vec3 max = data.meshes[0].bounds.max;
+            for (const auto &mesh : data.meshes) {
+                min = glm::min(min, mesh.bounds.min);
+                max = glm::max(max, mesh.bounds.max);
+            }
+            quantization = VertexQuantization::from_bounds(min, max);
+        }
+        draw_uniforms.position_offset = quantization.offset;
+        draw_uniforms.position_scale = quantization.scale;
+
+        if (!packed) {
             return ;
         }
 
-        // process scene graph 
-        const std::filesystem::path ps(filepath);
-        process_node(scene->mRootNode, scene, ps.parent_path().string());
+        // allocate the shared buffers up front, meshes are copied into their sub-ranges one by one
+        std::size_t n_vertices = 0;
+        std::size_t n_buffer_index_bytes = 0;
+        for (const auto &mesh : data.meshes) {
+            n_vertices += mesh.vertex_count();
+            n_buffer_index_bytes = align_index_offset(n_buffer_index_bytes) +
+                mesh.index_count() * IndexBuffer::size_of(IndexBuffer::type_for(mesh.vertex_count(), short_indices));
+        }
+
+        VAO.create();
+        VBO.create();
+        EBO.create();
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, n_vertices * vertex_size(), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_buffer_index_bytes, nullptr, GL_STATIC_DRAW);
+        Mesh::set_vertex_layout(compact);
+        glBindVertexArray(0);
+
+        n_packed_vertices = 0;
+        n_packed_index_bytes = 0;
+    }
+
+    void add_texture(TextureData &texture) {
+        std::shared_ptr<Texture> resident = TextureCache::instance().acquire(texture);
 
-        // show info
-        std::cout << "[Model] " << filepath << " loaded." << std::endl;
+        // the same image may be used as a different texture type by another model
+        Texture view = *resident;
+        view.filepath = texture.filepath;
+        view.texture_type = texture.texture_type;
+        textures.push_back(view);
+        texture_references.push_back(std::move(resident));
+        texture_keys.push_back(texture.key);
+    }
+
+    void add_mesh(MeshData &&mesh) {
+        n_vertex_bytes += mesh.vertex_count() * vertex_size();
+        n_full_vertex_bytes += mesh.vertex_count() * sizeof(Vertex);
+        n_full_index_bytes += mesh.index_count() * sizeof(unsigned int);
+        if (!packed) {
+            meshes.emplace_back(std::move(mesh), compact ? &quantization : nullptr, short_indices, keep_geometry);
+            n_index_bytes += meshes.back().indices.size_in_bytes();
+            return ;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (compact) {
+            std::vector<CompactVertex> vertices(mesh.vertex_count());
+            const Vertex *vertex_data = mesh.vertex_data();
+            for (std::size_t i = 0; i < vertices.size(); ++i) {
+                vertices[i] = quantization.compress(vertex_data[i]);
+            }
+            glBufferSubData(GL_ARRAY_BUFFER, n_packed_vertices * sizeof(CompactVertex), vertices.size() * sizeof(CompactVertex), vertices.data());
+        } else {
+            glBufferSubData(GL_ARRAY_BUFFER, n_packed_vertices * sizeof(Vertex), mesh.vertex_count() * sizeof(Vertex), mesh.vertex_data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        IndexBuffer indices(mesh.index_data(), mesh.index_count(), mesh.vertex_count(), short_indices);
+        const std::size_t index_offset = align_index_offset(n_packed_index_bytes);
+        // the element array binding is VAO state
+        glBindVertexArray(VAO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_offset, indices.size_in_bytes(), indices.data());
+        glBindVertexArray(0);
+        n_index_bytes += indices.size_in_bytes();
+
+        const GLint base_vertex = static_cast<GLint>(n_packed_vertices);
+        n_packed_vertices += mesh.vertex_count();
+        n_packed_index_bytes = index_offset + indices.size_in_bytes();
+        meshes.emplace_back(std::move(mesh), std::move(indices), base_vertex, index_offset, keep_geometry);
+    }
+
+    void end_upload() {
+        upload_materials();
+
+        std::vector<Bounds> bounds;
+        for (const auto &mesh : meshes) {
+            bounds.push_back(mesh.bounds);
+        }
+        culling_bounds.build(bounds);
+        compute_bounds();
+        create_instance_buffer();
+
+        // group meshes that share a material and index type so that each group is a single multi-draw
+        draw_groups.clear();
+        if (!packed) {
+            return ;
+        }
+
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            const Mesh &mesh = meshes[i];
+            DrawGroup *group = nullptr;
+            for (auto &candidate : draw_groups) {
+                if (candidate.index_type == mesh.indices.index_type() && meshes[candidate.mesh].same_material(mesh)) {
+                    group = &candidate;
+                    break;
+                }
+            }
+            if (!group) {
+                draw_groups.emplace_back();
+                group = &draw_groups.back();
+                group->mesh = i;
+                group->index_type = mesh.indices.index_type();
+            }
+            group->meshes.push_back(i);
+        }
+    }
+
+    void print_info(const ModelData &data) const {
+        std::cout << "[Model] " << data.filepath << " loaded." << std::endl;
+        std::cout << "[Model] import time: " << data.import_milliseconds << " ms (" << (data.from_cache ? "cache hit" : "cache miss") << ")" << std::endl;
+        if (!data.from_cache) {
+            std::cout << "[Model] parse time: " << data.parse_milliseconds << " ms (" << data.importer << ")" << std::endl;
+        }
         std::cout << "[Model] number of meshes: " << meshes.size() << std::endl;
 
+        // meshes without a level count with their coarsest one
         std::size_t nVertices = 0;
-        std::size_t nFaces = 0;
+        std::size_t nFaces[Simplifier::max_lod_levels] = {};
         for (std::size_t i = 0; i < meshes.size(); ++i) {
-            nVertices += meshes[i].vertices.size();
-            nFaces += meshes[i].indices.size() / 3;
+            nVertices += meshes[i].vertex_count();
+            for (std::size_t level = 0; level < Simplifier::max_lod_levels; ++level) {
+                nFaces[level] += meshes[i].lods[std::min(level, meshes[i].lods.size() - 1)].index_count / 3;
+            }
         }
         std::cout << "[Model] number of vertices: " << nVertices << std::endl;
-        std::cout << "[Model] number of faces: " << nFaces << std::endl;
+        std::cout << "[Model] number of faces: " << nFaces[0] << std::endl;
+        for (std::size_t level = 1; level < Simplifier::max_lod_levels && nFaces[level] < nFaces[level - 1]; ++level) {
+            std::cout << "[Model] number of faces at LOD " << level << ": " << nFaces[level] << std::endl;
+        }
+        for (std::size_t i = 0; i < data.cache_statistics.size(); ++i) {
+            const auto &before = data.cache_statistics[i].first;
+            const auto &after = data.cache_statistics[i].second;
+            std::cout << "[Model] mesh " << i << " ACMR: " << before.acmr << " -> " << after.acmr
+                << ", ATVR: " << before.atvr << " -> " << after.atvr << std::endl;
+        }
         std::cout << "[Model] number of textures: " << textures.size() << std::endl;
+        const TextureCache &texture_cache = TextureCache::instance();
+        std::cout << "[Model] resident texture memory: " << texture_cache.get_resident_bytes() / 1048576.0 << " MB ("
+            << (texture_cache.get_compression() ? "BC1" : "RGB8") << ")" << std::endl;
+        std::cout << "[Model] vertex memory: " << n_vertex_bytes / 1048576.0 << " MB";
+        if (compact) {
+            std::cout << " (compact, " << (n_full_vertex_bytes - n_vertex_bytes) / 1048576.0 << " MB saved)";
+        }
+        std::cout << ", index memory: " << n_index_bytes / 1048576.0 << " MB";
+        if (short_indices) {
+            std::cout << " (" << (n_full_index_bytes - n_index_bytes) / 1048576.0 << " MB saved by 16 bit indices)";
+        }
+        std::cout << std::endl;
+        if (packed) {
+            std::cout << "[Model] number of draw groups: " << draw_groups.size() << std::endl;
+        }
+        const MemoryUsage memory = MemoryUsage::current();
+        if (memory.resident_bytes > 0) {
+            std::cout << "[Model] resident memory: " << memory.resident_bytes / 1048576.0 << " MB (peak "
+                << memory.peak_resident_bytes / 1048576.0 << " MB, CPU geometry " << (keep_geometry ? "kept" : "released") << ")" << std::endl;
+        }
     }
 
-    void draw(const Shader &shader) const {
+    // queues the draws of this model, see DrawQueue; materials come from the material UBO,
+    // each mesh is drawn with the variant of pass for its material and the vertex format,
+    // meshes whose variant is still being built are skipped;
+    // with a frustum, meshes whose bounds are outside of it are skipped,
+    // with a LOD selector, every mesh is drawn at the level it selects, and draws that share
+    // vertex array and material are sorted front to back (with packed geometry all draws of a
+    // material, per-mesh vertex arrays keep meshes apart);
+    // every draw is repeated for the first n_instances matrices of set_instances()
+    void submit(DrawQueue &queue, ShaderLibrary &shaders, ShaderPass pass, const Frustum *frustum = nullptr,
+                const LodSelector *lod_selector = nullptr, std::size_t n_instances = 1) const {
+        FrameStats &stats = FrameStats::current();
+        if (frustum) {
+            ProfileScope scope("culling");
+            culling_bounds.cull(*frustum, visible);
+        } else {
+            visible.assign(meshes.size(), 1);
+        }
+        const std::size_t n_visible = std::count(visible.begin(), visible.end(), 1);
+        stats.meshes_submitted += n_visible;
+        stats.meshes_culled += visible.size() - n_visible;
+
+        lod_levels.assign(meshes.size(), 0);
+        distances.assign(meshes.size(), 0.0f);
+        texture_coverage.assign(texture_keys.size(), 0.0f);
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            if (!visible[i]) {
+                continue;
+            }
+            if (lod_selector) {
+                lod_levels[i] = static_cast<std::uint8_t>(lod_selector->select(meshes[i]));
+                distances[i] = lod_selector->distance(meshes[i].bounds);
+                // mip levels the texture streaming has to provide
+                const float pixels = lod_selector->screen_size(meshes[i].bounds);
+                for (unsigned int texture : meshes[i].indices_of_textures) {
+                    texture_coverage[texture] = std::max(texture_coverage[texture], pixels);
+                }
+            }
+            stats.triangles += meshes[i].lods[lod_levels[i]].index_count / 3 * n_instances;
+        }
+        if (lod_selector) {
+            request_textures();
+        }
+
+        DrawCommand command;
+        command.uniforms = &draw_uniforms;
+        command.n_instances = static_cast<GLsizei>(n_instances);
+        const unsigned uniforms_slot = queue.uniforms_slot(draw_uniforms);
+        if (packed) {
+            submit_packed(queue, command, shaders, pass, uniforms_slot);
+            return ;
+        }
         for (std::size_t i = 0; i < meshes.size(); i++) {
-            meshes[i].draw(shader, textures);
+            if (!visible[i]) {
+                continue;
+            }
+            const Mesh &mesh = meshes[i];
+            command.shader = shaders.get(pass, vertex_features() | mesh.get_shader_features());
+            if (!command.shader) {
+                continue;
+            }
+            const unsigned program_slot = queue.program_slot(*command.shader);
+            const LodLevel &lod = mesh.lods[lod_levels[i]];
+            command.key = DrawKey::make(program_slot, uniforms_slot, mesh.get_texture_set(), mesh.get_vertex_array(),
+                mesh.get_material_id(), distances[i]);
+            command.textures = texture_set(mesh.get_texture_set());
+            command.vertex_array = mesh.get_vertex_array();
+            command.material_buffer = mesh.get_material_buffer();
+            command.material_offset = mesh.get_material_offset();
+            command.index_type = mesh.indices.index_type();
+            command.first_draw = queue.add_draw(static_cast<GLsizei>(lod.index_count),
+                reinterpret_cast<const void*>(lod.first_index * mesh.indices.index_size()), 0);
+            command.n_draws = 1;
+            command.profile_name = "mesh";
+            command.profile_index = static_cast<int>(i);
+            queue.push(command);
+        }
+    }
+
+    // asks texture streaming again for the mip levels the last submit() needed, for frames that
+    // reuse an earlier image instead of drawing
+    void request_textures() const {
+        if (!texture_keys.empty() && texture_coverage.size() == texture_keys.size()) {
+            TextureCache::instance().request(texture_keys, texture_coverage);
+        }
+    }
+
+    // instances drawn by submit() read their matrices from buffer at offset, e.g. a UniformRing;
+    // the identity matrix of the model's own buffer by default
+    //
+    // the vertex arrays are only re-pointed when buffer, generation or offset differ from the last
+    // call; a caller that deletes and recreates its buffer must pass a new generation, since the
+    // new buffer often gets the old name (see UniformRing::get_generation); generation 0 is the
+    // model's own buffer
+    void set_instances(GLuint buffer, std::uint64_t generation, GLintptr offset) {
+        if (instance_VBO == 0 || (buffer == instance_buffer && generation == instance_generation && offset == instance_offset)) {
+            return ;
         }
+        instance_buffer = buffer;
+        instance_generation = generation;
+        instance_offset = offset;
+        attach_instances();
+    }
+
+    // sphere around all meshes, in model space
+    const Bounds &get_bounds() const {
+        return bounds;
     }
 
     void destroy() {
@@ -67,45 +450,267 @@ public:
             mesh.destroy();
         }
         meshes.clear();
+        draw_groups.clear();
+        culling_bounds.build({});
 
-        for (auto &texture : textures) {
-            texture.destroy();
-        }
+        material_UBO.reset();
+
+        VBO.reset();
+        EBO.reset();
+        VAO.reset();
+        packed = false;
+        instance_VBO.reset();
+        instance_buffer = 0;
+        instance_generation = 0;
+        instance_offset = 0;
+
+        // textures stay resident in the TextureCache for the next model
         textures.clear();
+        texture_references.clear();
+        texture_keys.clear();
+        texture_sets.clear();
+        TextureCache::instance().trim();
     }
 
 private:
+    static constexpr unsigned int import_flags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals;
+
     std::vector<Mesh> meshes;
     std::vector<Texture> textures;
+    std::vector<std::shared_ptr<Texture>> texture_references;
+    std::vector<std::uint64_t> texture_keys;
+    // textures bound together to units 0, 1, ..., see Mesh::prepare_material
+    std::vector<TextureSet> texture_sets;
+    DrawUniforms draw_uniforms;
+
+    // meshes with equal material drawn by one glMultiDrawElementsBaseVertex
+    struct DrawGroup {
+        std::size_t mesh; // first mesh of the group, provides the material
+        GLenum index_type;
+        std::vector<std::size_t> meshes;
+    };
+
+    // compact vertices, see CompactVertex; identity quantization for full vertices
+    bool compact = false;
+    VertexQuantization quantization;
+    std::size_t n_vertex_bytes = 0;
+    std::size_t n_full_vertex_bytes = 0;
+    std::size_t n_index_bytes = 0;
+    std::size_t n_full_index_bytes = 0;
+
+    // 16 bit indices for meshes with at most IndexBuffer::max_short_vertices vertices
+    bool short_indices = true;
+    // CPU copies of the geometry in Mesh::vertices / Mesh::indices after upload
+    bool keep_geometry = false;
+
+    // packed geometry
+    bool packed = false;
+    GLVertexArray VAO;
+    GLBuffer VBO;
+    GLBuffer EBO;
+    std::size_t n_packed_vertices = 0;
+    std::size_t n_packed_index_bytes = 0;
+    std::vector<DrawGroup> draw_groups;
+
+    CullingBounds culling_bounds;
+    Bounds bounds{glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+
+    // one glm::mat4 per instance, attached to every VAO of the model
+    GLBuffer instance_VBO;
+    GLuint instance_buffer = 0;
+    std::uint64_t instance_generation = 0;
+    GLintptr instance_offset = 0;
+    // per-frame scratch of submit(): mesh visibility, LOD and distance to the eye
+    mutable std::vector<std::uint8_t> visible;
+    mutable std::vector<std::uint8_t> lod_levels;
+    mutable std::vector<float> distances;
+    mutable std::vector<std::size_t> group_order;
+    mutable std::vector<float> texture_coverage;
+
+    // one MaterialBlock per distinct material, each at a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    GLBuffer material_UBO;
+
+    std::size_t vertex_size() const {
+        return compact ? sizeof(CompactVertex) : sizeof(Vertex);
+    }
+
+    // 32 bit indices after 16 bit ones must stay aligned to their size
+    static std::size_t align_index_offset(std::size_t offset) {
+        return (offset + 3) & ~static_cast<std::size_t>(3);
+    }
 
-    void process_node(
+    ShaderFeatures vertex_features() const {
+        return compact ? feature_bit(ShaderFeature::CompactVertices) : 0;
+    }
+
+    // one multi-draw per draw group, of its visible meshes at their selected LOD
+    void submit_packed(DrawQueue &queue, DrawCommand &command, ShaderLibrary &shaders, ShaderPass pass, unsigned uniforms_slot) const {
+        command.vertex_array = VAO;
+        command.profile_name = "mesh group";
+        for (std::size_t i = 0; i < draw_groups.size(); ++i) {
+            const DrawGroup &group = draw_groups[i];
+            // the meshes of a group share their material, so also the variant
+            command.shader = shaders.get(pass, vertex_features() | meshes[group.mesh].get_shader_features());
+            if (!command.shader) {
+                continue;
+            }
+
+            // the draws of a group front to back, its command is keyed by the closest one
+            group_order.clear();
+            for (const auto j : group.meshes) {
+                if (visible[j]) {
+                    group_order.push_back(j);
+                }
+            }
+            std::stable_sort(group_order.begin(), group_order.end(), [this](std::size_t a, std::size_t b) {
+                return distances[a] < distances[b];
+            });
+
+            command.first_draw = queue.draw_count();
+            float distance = std::numeric_limits<float>::max();
+            for (const auto j : group_order) {
+                const Mesh &mesh = meshes[j];
+                const LodLevel &lod = mesh.lods[lod_levels[j]];
+                queue.add_draw(static_cast<GLsizei>(lod.index_count),
+                    reinterpret_cast<const void*>(mesh.get_index_offset() + lod.first_index * mesh.indices.index_size()), mesh.get_base_vertex());
+                distance = std::min(distance, distances[j]);
+            }
+            command.n_draws = queue.draw_count() - command.first_draw;
+            if (command.n_draws == 0) {
+                continue;
+            }
+
+            const Mesh &mesh = meshes[group.mesh];
+            command.key = DrawKey::make(queue.program_slot(*command.shader), uniforms_slot, mesh.get_texture_set(), VAO,
+                mesh.get_material_id(), distance);
+            command.textures = texture_set(mesh.get_texture_set());
+            command.material_buffer = mesh.get_material_buffer();
+            command.material_offset = mesh.get_material_offset();
+            command.index_type = group.index_type;
+            command.profile_index = static_cast<int>(i);
+            queue.push(command);
+        }
+    }
+
+    void compute_bounds() {
+        bounds.min = meshes.empty() ? glm::vec3(0.0f) : meshes[0].bounds.min;
+        bounds.max = bounds.min;
+        bounds.radius = 0.0f;
+        for (const auto &mesh : meshes) {
+            bounds.min = glm::min(bounds.min, mesh.bounds.min);
+            bounds.max = glm::max(bounds.max, mesh.bounds.max);
+        }
+        bounds.center = 0.5f * (bounds.min + bounds.max);
+        for (const auto &mesh : meshes) {
+            bounds.radius = std::max(bounds.radius, glm::length(mesh.bounds.center - bounds.center) + mesh.bounds.radius);
+        }
+    }
+
+    // starts with a single identity instance, so a model drawn without a Scene stays where it is
+    void create_instance_buffer() {
+        const glm::mat4 identity(1.0f);
+        instance_VBO.create();
+        glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4), &identity, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        instance_buffer = instance_VBO;
+        instance_generation = 0;
+        instance_offset = 0;
+        attach_instances();
+    }
+
+    void attach_instances() const {
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        auto attach = [this](GLuint vertex_array) {
+            glBindVertexArray(vertex_array);
+            Mesh::set_instance_layout(instance_offset);
+        };
+        if (packed) {
+            attach(VAO);
+        } else {
+            for (const auto &mesh : meshes) {
+                attach(mesh.get_vertex_array());
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    const TextureSet *texture_set(std::size_t set) const {
+        return set < texture_sets.size() ? &texture_sets[set] : nullptr;
+    }
+
+    void upload_materials() {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        const std::size_t stride = (sizeof(MaterialBlock) + alignment - 1) / alignment * alignment;
+
+        if (material_UBO == 0) {
+            material_UBO.create();
+        }
+
+        // meshes in order, which is also the order of the draw groups, so that a new set starts
+        // only when the current one is full; models with up to max_material_textures textures bind once
+        texture_sets.assign(1, TextureSet());
+        // meshes with equal blocks share one, so that their draws only differ in depth
+        std::vector<MaterialBlock> unique_blocks;
+        for (std::size_t i = 0; i < meshes.size(); ++i) {
+            MaterialBlock block;
+            if (!meshes[i].prepare_material(textures, texture_sets.back(), texture_sets.size() - 1, block)) {
+                texture_sets.emplace_back();
+                meshes[i].prepare_material(textures, texture_sets.back(), texture_sets.size() - 1, block);
+            }
+            std::size_t id = 0;
+            while (id < unique_blocks.size() && std::memcmp(&unique_blocks[id], &block, sizeof(MaterialBlock)) != 0) {
+                id++;
+            }
+            if (id == unique_blocks.size()) {
+                unique_blocks.push_back(block);
+            }
+            meshes[i].set_material(material_UBO, static_cast<GLintptr>(id * stride), id);
+        }
+        std::vector<unsigned char> blocks(unique_blocks.size() * stride);
+        for (std::size_t id = 0; id < unique_blocks.size(); ++id) {
+            std::memcpy(blocks.data() + id * stride, &unique_blocks[id], sizeof(MaterialBlock));
+        }
+
+        glBindBuffer(GL_UNIFORM_BUFFER, material_UBO);
+        glBufferData(GL_UNIFORM_BUFFER, blocks.size(), blocks.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    static void process_node(
         const aiNode *node, 
         const aiScene *scene, 
-        const std::string &parent_path
+        const std::string &parent_path,
+        ModelData &data
     ) {
         for (std::size_t i = 0; i < node->mNumMeshes; ++i) {
             const aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(process_mesh(mesh, scene, parent_path));
+            data.meshes.push_back(process_mesh(mesh, scene, parent_path, data.textures));
         }
 
         for (std::size_t i = 0; i < node->mNumChildren; i++) {
-            process_node(node->mChildren[i], scene, parent_path);
+            process_node(node->mChildren[i], scene, parent_path, data);
         }
     }
 
-    Mesh process_mesh(
+    static MeshData process_mesh(
         const aiMesh *mesh,
         const aiScene *scene,
-        const std::string &parent_path
+        const std::string &parent_path,
+        std::vector<TextureData> &textures
     ) {
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-        Material material;
-        std::vector<unsigned int> indices_of_textures;
-
-        // vertices
+        MeshData data;
+        std::vector<Vertex> &vertices = data.vertices;
+        std::vector<unsigned int> &indices = data.indices;
+        Material &material = data.material;
+        std::vector<unsigned int> &indices_of_textures = data.indices_of_textures;
+
+        // vertices, written once into a buffer of the final size
+        vertices.resize(mesh->mNumVertices);
         for (std::size_t i = 0; i < mesh->mNumVertices; ++i) {
-            Vertex vertex;
+            Vertex &vertex = vertices[i];
             vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
 
             if (mesh->mNormals) {
@@ -119,16 +724,19 @@ private:
             } else {
                 vertex.tex_coords = glm::vec2(0.0f, 0.0f);
             }
-
-            vertices.push_back(vertex);
         }
+        data.bounds = Bounds::compute(vertices.data(), vertices.size());
 
         // indices
+        std::size_t n_indices = 0;
+        for (std::size_t i = 0; i < mesh->mNumFaces; ++i) {
+            n_indices += mesh->mFaces[i].mNumIndices;
+        }
+        indices.resize(n_indices);
+        unsigned int *index = indices.data();
         for (std::size_t i = 0; i < mesh->mNumFaces; ++i) {
             const aiFace& face = mesh->mFaces[i];
-            for (std::size_t j = 0; j < face.mNumIndices; ++j) {
-                indices.push_back(face.mIndices[j]);
-            }
+            index = std::copy(face.mIndices, face.mIndices + face.mNumIndices, index);
         }
 
         // materials
@@ -159,7 +767,7 @@ private:
                 const std::filesystem::path ps(str.C_Str());
                 const std::string texture_path = (ps_parent / ps).string();
 
-                const auto index = has_texture(texture_path);
+                const auto index = has_texture(textures, texture_path);
                 if (index) {
                     // add texture index
                     indices_of_textures.push_back(index.value());
@@ -167,9 +775,11 @@ private:
                     // add texture index
                     indices_of_textures.push_back(textures.size());
 
-                    // load texture
-                    textures.emplace_back(texture_path, TextureType::DIFFUSE);
-                    // textures.push_back({texture_path, TextureType::DIFFUSE});
+                    // texture is decoded later
+                    TextureData texture;
+                    texture.filepath = texture_path;
+                    texture.texture_type = TextureType::DIFFUSE;
+                    textures.push_back(std::move(texture));
                 }
             }
 
@@ -180,7 +790,7 @@ private:
                 const std::filesystem::path ps(str.C_Str());
                 const std::string texture_path = (ps_parent / ps).string();
 
-                const auto index = has_texture(texture_path);
+                const auto index = has_texture(textures, texture_path);
                 if (index) {
                     // add texture index
                     indices_of_textures.push_back(index.value());
@@ -188,19 +798,21 @@ private:
                     // add texture index
                     indices_of_textures.push_back(textures.size());
 
-                    // load texture
-                    textures.emplace_back(texture_path, TextureType::SPECULAR);
-                    // textures.push_back({texture_path, TextureType::SPECULAR});
+                    // texture is decoded later
+                    TextureData texture;
+                    texture.filepath = texture_path;
+                    texture.texture_type = TextureType::SPECULAR;
+                    textures.push_back(std::move(texture));
                 }
             }
         }
 
-        return Mesh(vertices, indices, material, indices_of_textures);
+        return data;
     }
 
-    std::optional<std::size_t> has_texture(const std::string &filepath) const {
+    static std::optional<std::size_t> has_texture(const std::vector<TextureData> &textures, const std::string &filepath) {
         for (std::size_t i = 0; i < textures.size(); ++i) {
-            const Texture &texture = textures[i];
+            const TextureData &texture = textures[i];
             if (texture.filepath == filepath) {
                 return i;
             }
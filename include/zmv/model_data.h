@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <zmv/mapped_file.h>
+#include <zmv/mesh.h>
+#include <zmv/mesh_optimizer.h>
+#include <zmv/texture.h>
+
+// how a model is imported and laid out on the GPU
+struct LoadOptions {
+    // one vertex/index buffer for the whole model instead of one per mesh
+    bool packed_geometry = true;
+    // 16 byte CompactVertex on the GPU instead of the 32 byte Vertex
+    bool compact_vertices = true;
+    // keep Mesh::vertices / Mesh::indices after upload, nothing in the viewer reads them
+    bool keep_cpu_geometry = false;
+    // OBJ files are read by ObjLoader instead of Assimp
+    bool fast_obj = true;
+    // 16 bit indices where a mesh has few enough vertices, larger meshes are split at import time
+    bool short_indices = true;
+    // simplified index buffers for distant meshes, built at import time
+    bool generate_lods = true;
+    // reorder triangles and vertices for the post-transform cache and fetch locality
+    bool optimize_vertex_cache = true;
+    // additionally sort triangle clusters front to back from the outside, costs some cache efficiency
+    bool optimize_overdraw = false;
+
+    // options that change the imported data and therefore the mesh cache entry
+    unsigned int processing_flags() const {
+        unsigned int flags = 0;
+        if (generate_lods) {
+            flags |= 1u << 0;
+        }
+        if (optimize_vertex_cache) {
+            flags |= 1u << 1;
+            if (optimize_overdraw) {
+                flags |= 1u << 2;
+            }
+        }
+        if (short_indices) {
+            flags |= 1u << 3;
+        }
+        if (fast_obj) {
+            flags |= 1u << 4;
+        }
+        return flags;
+    }
+};
+
+// everything the GL thread needs to build a Model, produced by Model::import_model
+struct ModelData {
+    std::string filepath;
+    std::vector<MeshData> meshes;
+    std::vector<TextureData> textures;
+    bool from_cache = false;
+    double import_milliseconds = 0.0;
+    // the file parser that was used and its share of the import time, on a cache miss
+    std::string importer;
+    double parse_milliseconds = 0.0;
+    // per mesh post-transform cache statistics before and after optimization, empty on a cache hit
+    std::vector<std::pair<MeshOptimizer::CacheStatistics, MeshOptimizer::CacheStatistics>> cache_statistics;
+
+    // backing storage of mapped MeshData geometry
+    MappedFile mapping;
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <zmv/model.h>
+#include <zmv/model_data.h>
+#include <zmv/texture_cache.h>
+#include <zmv/thread_pool.h>
+
+// loads models in the background
+//
+// parsing, vertex conversion and image decoding run on the thread pool,
+// the GL thread calls update() once per frame to upload the result within a time budget
+class ModelLoader {
+public:
+    ModelLoader() { }
+
+    ModelLoader(const ModelLoader &) = delete;
+    ModelLoader &operator=(const ModelLoader &) = delete;
+
+    ~ModelLoader() {
+        cancel();
+    }
+
+    // start loading, a load that is still in flight is abandoned
+    void request(const std::string &filepath, const LoadOptions &options = LoadOptions()) {
+        cancel();
+
+        job = std::make_shared<Job>();
+        job->filepath = filepath;
+        job->options = options;
+
+        std::shared_ptr<Job> pending = job;
+        ThreadPool &pool = ThreadPool::instance();
+        pool.submit([pending, &pool] {
+            std::optional<ModelData> data = Model::import_model(pending->filepath, pending->options);
+            if (!data || pending->cancelled) {
+                pending->stage = Stage::Failed;
+                return ;
+            }
+
+            pending->data = std::move(*data);
+            pending->n_textures = pending->data.textures.size();
+            if (pending->n_textures == 0) {
+                pending->stage = Stage::Upload;
+                return ;
+            }
+
+            // decode every texture that is not resident yet in parallel,
+            // the last one to finish hands the job to the GL thread
+            pending->stage = Stage::Decode;
+            for (auto &texture : pending->data.textures) {
+                pool.submit([pending, &texture] {
+                    if (!pending->cancelled) {
+                        TextureCache::instance().prepare(texture);
+                    }
+                    if (++pending->n_decoded == pending->n_textures) {
+                        pending->stage = Stage::Upload;
+                    }
+                });
+            }
+        });
+    }
+
+    // returns true when a newly loaded model has replaced `model`
+    bool update(Model &model, double budget_milliseconds = 4.0) {
+        if (!job) {
+            return false;
+        }
+
+        if (job->stage == Stage::Failed) {
+            job.reset();
+            return false;
+        }
+        if (job->stage != Stage::Upload) {
+            return false;
+        }
+
+        // upload textures first, then meshes; at least one item is uploaded per frame
+        const auto start = std::chrono::steady_clock::now();
+        auto within_budget = [&]() {
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            return elapsed.count() < budget_milliseconds;
+        };
+
+        ModelData &data = job->data;
+        if (!job->upload_started) {
+            job->model.begin_upload(data, job->options);
+            job->upload_started = true;
+        }
+        do {
+            if (job->n_uploaded_textures < data.textures.size()) {
+                TextureData &texture = data.textures[job->n_uploaded_textures++];
+                job->model.add_texture(texture);
+                // release decoded pixels as soon as they are on the GPU
+                texture.pixels.reset();
+                texture.compressed = CompressedImage();
+            } else if (job->n_uploaded_meshes < data.meshes.size()) {
+                job->model.add_mesh(std::move(data.meshes[job->n_uploaded_meshes++]));
+            } else {
+                break;
+            }
+        } while (within_budget());
+
+        if (job->n_uploaded_textures < data.textures.size() || job->n_uploaded_meshes < data.meshes.size()) {
+            return false;
+        }
+
+        // swap in the new model only now, so the old one stays on screen while loading
+        job->model.end_upload();
+        job->model.print_info(data);
+        model.destroy();
+        model = std::move(job->model);
+        job.reset();
+        return true;
+    }
+
+    bool is_loading() const {
+        return static_cast<bool>(job);
+    }
+
+    // overall progress in [0, 1]
+    float progress() const {
+        if (!job) {
+            return 0.0f;
+        }
+        switch (job->stage.load()) {
+            case Stage::Parse:
+                return 0.0f;
+            case Stage::Decode:
+                return 0.1f + 0.4f * job->n_decoded / job->n_textures;
+            case Stage::Upload: {
+                const std::size_t n_items = job->data.textures.size() + job->data.meshes.size();
+                const std::size_t n_uploaded = job->n_uploaded_textures + job->n_uploaded_meshes;
+                return n_items > 0 ? 0.5f + 0.5f * n_uploaded / n_items : 1.0f;
+            }
+            case Stage::Failed:
+                return 1.0f;
+        }
+        return 0.0f;
+    }
+
+    std::string status() const {
+        if (!job) {
+            return "";
+        }
+        char str[64];
+        switch (job->stage.load()) {
+            case Stage::Parse:
+                return "parsing";
+            case Stage::Decode:
+                std::snprintf(str, sizeof(str), "decoding textures %zu/%zu", job->n_decoded.load(), job->n_textures);
+                return str;
+            case Stage::Upload:
+                std::snprintf(str, sizeof(str), "uploading %zu/%zu",
+                    job->n_uploaded_textures + job->n_uploaded_meshes,
+                    job->data.textures.size() + job->data.meshes.size());
+                return str;
+            case Stage::Failed:
+                return "failed";
+        }
+        return "";
+    }
+
+    // drop the pending model; GL objects that were already created are released
+    void cancel() {
+        if (!job) {
+            return ;
+        }
+        job->cancelled = true;
+        if (job->stage == Stage::Upload) {
+            job->model.destroy();
+        }
+        job.reset();
+    }
+
+private:
+    enum class Stage {
+        Parse, Decode, Upload, Failed
+    };
+
+    struct Job {
+        std::string filepath;
+        LoadOptions options;
+        std::atomic<Stage> stage{Stage::Parse};
+        std::atomic<bool> cancelled{false};
+
+        // written by the worker before stage becomes Decode or Upload
+        ModelData data;
+        std::size_t n_textures = 0;
+        std::atomic<std::size_t> n_decoded{0};
+
+        // GL thread only
+        Model model;
+        bool upload_started = false;
+        std::size_t n_uploaded_textures = 0;
+        std::size_t n_uploaded_meshes = 0;
+    };
+
+    std::shared_ptr<Job> job;
+};
@@ -0,0 +1,658 @@
+#pragma once
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <zmv/mapped_file.h>
+#include <zmv/mesh.h>
+#include <zmv/model_data.h>
+#include <zmv/thread_pool.h>
+
+// Wavefront OBJ/MTL importer, the fast path next to Assimp for the bundled models
+//
+// the file is memory mapped and split into chunks at line boundaries that are parsed in parallel,
+// then a serial pass resolves the v/vt/vn indices and deduplicates the tuples straight into
+// the final vertices; the result matches Assimp with Triangulate | FlipUVs | GenNormals:
+// polygons are fanned into triangles, v is flipped and faces without normals get flat ones
+class ObjLoader {
+public:
+    // nullopt when the file cannot be read or is malformed, the caller falls back to Assimp
+    static std::optional<ModelData> load(const std::string &filepath) {
+        MappedFile file(filepath);
+        if (!file) {
+            return std::nullopt;
+        }
+        const char *begin = reinterpret_cast<const char*>(file.data());
+        const char *end = begin + file.size();
+
+        // chunks of at least 256 KB, split after a newline
+        constexpr std::size_t min_chunk_size = 256 * 1024;
+        const std::size_t n_threads = ThreadPool::instance().size() + 1;
+        const std::size_t n_chunks = std::max<std::size_t>(1, std::min(n_threads * 4, file.size() / min_chunk_size));
+        std::vector<const char*> bounds(n_chunks + 1, end);
+        bounds[0] = begin;
+        for (std::size_t i = 1; i < n_chunks; ++i) {
+            const char *split = std::max(bounds[i - 1], begin + file.size() * i / n_chunks);
+            const char *newline = static_cast<const char*>(std::memchr(split, '\n', end - split));
+            bounds[i] = newline ? newline + 1 : end;
+        }
+
+        std::vector<Chunk> chunks(n_chunks);
+        ThreadPool::instance().parallel_for(n_chunks, [&](std::size_t i) {
+            parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+        });
+
+        ModelData data;
+        data.filepath = filepath;
+        if (!build(chunks, std::filesystem::path(filepath).parent_path(), data)) {
+            std::cerr << "[ObjLoader] " << filepath << " has invalid indices" << std::endl;
+            return std::nullopt;
+        }
+        return data;
+    }
+
+    // file names of an mtllib line, which may list several libraries separated by whitespace;
+    // also used by MeshCache to track the libraries of a cached model
+    static std::vector<std::string> split_material_libraries(const std::string &arguments) {
+        std::vector<std::string> names;
+        const char *p = arguments.data();
+        const char *end = p + arguments.size();
+        while (true) {
+            p = skip_spaces(p, end);
+            if (p >= end) {
+                break;
+            }
+            const char *name_end = p;
+            while (name_end < end && !is_space(*name_end)) {
+                name_end++;
+            }
+            names.emplace_back(p, name_end);
+            p = name_end;
+        }
+        return names;
+    }
+
+private:
+    static constexpr std::int32_t no_index = INT32_MIN;
+
+    struct Corner {
+        std::int32_t v;
+        std::int32_t vt;
+        std::int32_t vn;
+    };
+
+    // o, g, usemtl and mtllib lines, in order with the faces around them
+    struct Statement {
+        enum class Type { Group, UseMaterial, MaterialLibrary };
+        Type type;
+        std::size_t n_faces_before;
+        std::string name;
+    };
+
+    // what one chunk of the file contains, indices are still relative to the chunk
+    struct Chunk {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> tex_coords;
+        std::vector<glm::vec3> normals;
+        std::vector<Corner> corners;
+        std::vector<std::uint32_t> face_sizes;
+        std::vector<Statement> statements;
+        // corners with negative indices, counted from the end of this chunk's elements so far;
+        // bit 0/1/2 of the mask tells which of v/vt/vn
+        std::vector<std::pair<std::size_t, std::uint8_t>> relative_corners;
+        bool valid = true;
+    };
+
+    // open addressing map from a v/vt/vn tuple to the index of its vertex in the current mesh
+    class VertexTable {
+    public:
+        void clear() {
+            n_entries = 0;
+            entries.assign(1024, Entry{{no_index, no_index, no_index}, 0});
+        }
+
+        // index of the tuple's vertex, or inserted with the value of next_index
+        unsigned int find_or_insert(const Corner &key, unsigned int next_index, bool &inserted) {
+            if ((n_entries + 1) * 2 > entries.size()) {
+                grow();
+            }
+            const std::size_t mask = entries.size() - 1;
+            for (std::size_t slot = hash(key) & mask; ; slot = (slot + 1) & mask) {
+                Entry &entry = entries[slot];
+                if (entry.key.v == no_index) {
+                    entry.key = key;
+                    entry.index = next_index;
+                    n_entries++;
+                    inserted = true;
+                    return next_index;
+                }
+                if (entry.key.v == key.v && entry.key.vt == key.vt && entry.key.vn == key.vn) {
+                    inserted = false;
+                    return entry.index;
+                }
+            }
+        }
+
+    private:
+        struct Entry {
+            Corner key;
+            unsigned int index;
+        };
+        std::vector<Entry> entries;
+        std::size_t n_entries = 0;
+
+        static std::size_t hash(const Corner &key) {
+            std::uint64_t h = static_cast<std::uint32_t>(key.v);
+            h = h * 0x9E3779B97F4A7C15ull + static_cast<std::uint32_t>(key.vt);
+            h = h * 0x9E3779B97F4A7C15ull + static_cast<std::uint32_t>(key.vn);
+            return static_cast<std::size_t>(h ^ (h >> 29));
+        }
+
+        void grow() {
+            std::vector<Entry> old = std::move(entries);
+            entries.assign(old.size() * 2, Entry{{no_index, no_index, no_index}, 0});
+            n_entries = 0;
+            bool inserted;
+            for (const auto &entry : old) {
+                if (entry.key.v != no_index) {
+                    find_or_insert(entry.key, entry.index, inserted);
+                }
+            }
+        }
+    };
+
+    struct ObjMaterial {
+        // Assimp's defaults for materials without these statements
+        Material material{glm::vec3(0.6f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f};
+        std::vector<std::string> diffuse_maps;
+        std::vector<std::string> specular_maps;
+    };
+
+    static bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char *skip_spaces(const char *p, const char *end) {
+        while (p < end && is_space(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    // the rest of the line without surrounding whitespace
+    static std::string rest_of_line(const char *p, const char *end) {
+        p = skip_spaces(p, end);
+        while (end > p && is_space(end[-1])) {
+            end--;
+        }
+        return std::string(p, end);
+    }
+
+    // decimal floats without locale or strtof: the significant digits are accumulated as an integer and
+    // scaled by an exact power of ten, which is correctly rounded for the short numbers OBJ exporters write
+    static const char *parse_float(const char *p, const char *end, float &value) {
+        static const double powers_of_ten[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        p = skip_spaces(p, end);
+        const char *start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        std::uint64_t mantissa = 0;
+        int exponent = 0;
+        int n_digits = 0;
+        int n_significant = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, ++n_digits) {
+            if (n_significant < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                n_significant += mantissa != 0;
+            } else {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++n_digits) {
+                if (n_significant < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    n_significant += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+        if (n_digits == 0) {
+            // inf, nan or garbage
+            return parse_float_fallback(start, end, value);
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            bool negative_exponent = false;
+            if (q < end && (*q == '-' || *q == '+')) {
+                negative_exponent = *q == '-';
+                q++;
+            }
+            if (q < end && *q >= '0' && *q <= '9') {
+                int e = 0;
+                for (; q < end && *q >= '0' && *q <= '9'; ++q) {
+                    e = std::min(e * 10 + (*q - '0'), 10000);
+                }
+                exponent += negative_exponent ? -e : e;
+                p = q;
+            }
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (mantissa == 0) {
+            result = 0.0;
+        } else if (exponent >= -22 && exponent <= 22 && mantissa < (1ull << 53)) {
+            result = exponent < 0 ? result / powers_of_ten[-exponent] : result * powers_of_ten[exponent];
+        } else {
+            return parse_float_fallback(start, end, value);
+        }
+        value = static_cast<float>(negative ? -result : result);
+        return p;
+    }
+
+    static const char *parse_float_fallback(const char *p, const char *end, float &value) {
+        char buffer[64];
+        const std::size_t length = std::min<std::size_t>(end - p, sizeof(buffer) - 1);
+        std::memcpy(buffer, p, length);
+        buffer[length] = '\0';
+        char *parsed = buffer;
+        value = std::strtof(buffer, &parsed);
+        return p + (parsed - buffer);
+    }
+
+    static const char *parse_int(const char *p, const char *end, std::int32_t &value, bool &ok) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+        std::int64_t result = 0;
+        const char *start = p;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            result = std::min<std::int64_t>(result * 10 + (*p - '0'), INT32_MAX);
+        }
+        ok = p != start;
+        value = static_cast<std::int32_t>(negative ? -result : result);
+        return p;
+    }
+
+    static bool starts_with(const char *p, const char *end, const char *keyword) {
+        const std::size_t length = std::strlen(keyword);
+        return static_cast<std::size_t>(end - p) > length && std::memcmp(p, keyword, length) == 0 && is_space(p[length]);
+    }
+
+    static void parse_chunk(const char *p, const char *end, Chunk &chunk) {
+        // a rough guess from the usual line length avoids most reallocations
+        const std::size_t n_lines_guess = (end - p) / 32;
+        chunk.positions.reserve(n_lines_guess / 3);
+        chunk.corners.reserve(n_lines_guess);
+
+        while (p < end) {
+            const char *line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!line_end) {
+                line_end = end;
+            }
+            p = skip_spaces(p, line_end);
+            if (p < line_end) {
+                parse_line(p, line_end, chunk);
+            }
+            p = line_end + 1;
+        }
+    }
+
+    static void parse_line(const char *p, const char *end, Chunk &chunk) {
+        switch (*p) {
+            case 'v':
+                if (end - p > 1 && is_space(p[1])) {
+                    glm::vec3 position;
+                    p = parse_float(p + 1, end, position.x);
+                    p = parse_float(p, end, position.y);
+                    parse_float(p, end, position.z);
+                    chunk.positions.push_back(position);
+                } else if (starts_with(p, end, "vt")) {
+                    glm::vec2 tex_coords;
+                    p = parse_float(p + 2, end, tex_coords.x);
+                    parse_float(p, end, tex_coords.y);
+                    chunk.tex_coords.push_back(tex_coords);
+                } else if (starts_with(p, end, "vn")) {
+                    glm::vec3 normal;
+                    p = parse_float(p + 2, end, normal.x);
+                    p = parse_float(p, end, normal.y);
+                    parse_float(p, end, normal.z);
+                    chunk.normals.push_back(normal);
+                }
+                break;
+            case 'f':
+                if (end - p > 1 && is_space(p[1])) {
+                    parse_face(p + 1, end, chunk);
+                }
+                break;
+            case 'o':
+            case 'g':
+                if (end - p == 1 || is_space(p[1])) {
+                    chunk.statements.push_back({Statement::Type::Group, chunk.face_sizes.size(), rest_of_line(p + 1, end)});
+                }
+                break;
+            case 'u':
+                if (starts_with(p, end, "usemtl")) {
+                    chunk.statements.push_back({Statement::Type::UseMaterial, chunk.face_sizes.size(), rest_of_line(p + 6, end)});
+                }
+                break;
+            case 'm':
+                if (starts_with(p, end, "mtllib")) {
+                    chunk.statements.push_back({Statement::Type::MaterialLibrary, chunk.face_sizes.size(), rest_of_line(p + 6, end)});
+                }
+                break;
+            default:
+                // comments, smoothing groups, lines and points
+                break;
+        }
+    }
+
+    // v, v/vt, v//vn or v/vt/vn per corner; 1-based, negative ones count back from the last element
+    static void parse_face(const char *p, const char *end, Chunk &chunk) {
+        std::uint32_t n_corners = 0;
+        while (true) {
+            p = skip_spaces(p, end);
+            if (p >= end) {
+                break;
+            }
+
+            Corner corner{no_index, no_index, no_index};
+            std::int32_t *fields[] = {&corner.v, &corner.vt, &corner.vn};
+            const std::int32_t counts[] = {
+                static_cast<std::int32_t>(chunk.positions.size()),
+                static_cast<std::int32_t>(chunk.tex_coords.size()),
+                static_cast<std::int32_t>(chunk.normals.size())
+            };
+            std::uint8_t relative = 0;
+            for (int field = 0; field < 3; ++field) {
+                if (field > 0) {
+                    if (p >= end || *p != '/') {
+                        break;
+                    }
+                    p++;
+                }
+                std::int32_t value;
+                bool ok;
+                p = parse_int(p, end, value, ok);
+                if (!ok) {
+                    // empty vt in v//vn, anything else is an error
+                    if (field == 0) {
+                        chunk.valid = false;
+                        return ;
+                    }
+                    continue;
+                }
+                if (value > 0) {
+                    *fields[field] = value - 1;
+                } else if (value < 0) {
+                    *fields[field] = counts[field] + value;
+                    relative |= 1u << field;
+                } else {
+                    chunk.valid = false;
+                    return ;
+                }
+            }
+            if (p < end && !is_space(*p)) {
+                chunk.valid = false;
+                return ;
+            }
+            if (relative) {
+                chunk.relative_corners.emplace_back(chunk.corners.size(), relative);
+            }
+            chunk.corners.push_back(corner);
+            n_corners++;
+        }
+        if (n_corners < 3) {
+            chunk.corners.resize(chunk.corners.size() - n_corners);
+            while (!chunk.relative_corners.empty() && chunk.relative_corners.back().first >= chunk.corners.size()) {
+                chunk.relative_corners.pop_back();
+            }
+            return ;
+        }
+        chunk.face_sizes.push_back(n_corners);
+    }
+
+    static std::unordered_map<std::string, ObjMaterial> load_material_library(const std::filesystem::path &filepath) {
+        std::unordered_map<std::string, ObjMaterial> materials;
+        MappedFile file(filepath.string());
+        if (!file) {
+            std::cerr << "[ObjLoader] failed to open material library " << filepath.string() << std::endl;
+            return materials;
+        }
+
+        const char *p = reinterpret_cast<const char*>(file.data());
+        const char *end = p + file.size();
+        ObjMaterial *current = nullptr;
+        auto parse_color = [&](const char *q, const char *line_end, glm::vec3 &color) {
+            q = parse_float(q, line_end, color.x);
+            q = parse_float(q, line_end, color.y);
+            parse_float(q, line_end, color.z);
+        };
+        // options like -bm 1.0 come before the file name
+        auto map_name = [](const std::string &arguments) {
+            const std::size_t space = arguments.find_last_of(" \t");
+            return space == std::string::npos ? arguments : arguments.substr(space + 1);
+        };
+        while (p < end) {
+            const char *line_end = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!line_end) {
+                line_end = end;
+            }
+            p = skip_spaces(p, line_end);
+            if (starts_with(p, line_end, "newmtl")) {
+                current = &materials[rest_of_line(p + 6, line_end)];
+            } else if (current) {
+                if (starts_with(p, line_end, "Kd")) {
+                    parse_color(p + 2, line_end, current->material.kd);
+                } else if (starts_with(p, line_end, "Ks")) {
+                    parse_color(p + 2, line_end, current->material.ks);
+                } else if (starts_with(p, line_end, "Ka")) {
+                    parse_color(p + 2, line_end, current->material.ka);
+                } else if (starts_with(p, line_end, "Ns")) {
+                    parse_float(p + 2, line_end, current->material.shininess);
+                } else if (starts_with(p, line_end, "map_Kd")) {
+                    current->diffuse_maps.push_back(map_name(rest_of_line(p + 6, line_end)));
+                } else if (starts_with(p, line_end, "map_Ks")) {
+                    current->specular_maps.push_back(map_name(rest_of_line(p + 6, line_end)));
+                }
+            }
+            p = line_end + 1;
+        }
+        return materials;
+    }
+
+    // serial pass over the parsed chunks in file order
+    static bool build(std::vector<Chunk> &chunks, const std::filesystem::path &parent_path, ModelData &data) {
+        // chunk indices become file indices
+        std::size_t n_positions = 0;
+        std::size_t n_tex_coords = 0;
+        std::size_t n_normals = 0;
+        for (auto &chunk : chunks) {
+            if (!chunk.valid) {
+                return false;
+            }
+            const std::int64_t bases[] = {
+                static_cast<std::int64_t>(n_positions),
+                static_cast<std::int64_t>(n_tex_coords),
+                static_cast<std::int64_t>(n_normals)
+            };
+            for (const auto &[corner_index, mask] : chunk.relative_corners) {
+                Corner &corner = chunk.corners[corner_index];
+                std::int32_t *fields[] = {&corner.v, &corner.vt, &corner.vn};
+                for (int field = 0; field < 3; ++field) {
+                    if (mask & (1u << field)) {
+                        *fields[field] = static_cast<std::int32_t>(*fields[field] + bases[field]);
+                    }
+                }
+            }
+            n_positions += chunk.positions.size();
+            n_tex_coords += chunk.tex_coords.size();
+            n_normals += chunk.normals.size();
+        }
+
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> tex_coords;
+        std::vector<glm::vec3> normals;
+        positions.reserve(n_positions);
+        tex_coords.reserve(n_tex_coords);
+        normals.reserve(n_normals);
+        for (auto &chunk : chunks) {
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            tex_coords.insert(tex_coords.end(), chunk.tex_coords.begin(), chunk.tex_coords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+            chunk.positions = {};
+            chunk.tex_coords = {};
+            chunk.normals = {};
+        }
+
+        std::unordered_map<std::string, ObjMaterial> materials;
+        const ObjMaterial default_material;
+        const ObjMaterial *material = &default_material;
+        MeshData mesh;
+        VertexTable table;
+        table.clear();
+
+        // a new mesh per o, g and usemtl, like Assimp; empty ones are dropped
+        auto finish_mesh = [&]() {
+            if (!mesh.indices.empty()) {
+                mesh.material = material->material;
+                add_textures(material->diffuse_maps, TextureType::DIFFUSE, parent_path, mesh, data.textures);
+                add_textures(material->specular_maps, TextureType::SPECULAR, parent_path, mesh, data.textures);
+                mesh.bounds = Bounds::compute(mesh.vertices.data(), mesh.vertices.size());
+                data.meshes.push_back(std::move(mesh));
+            }
+            mesh = MeshData();
+            table.clear();
+        };
+
+        // a corner without a normal gets its triangle's flat normal, a unique vn past the file's normals
+        std::int32_t next_generated_normal = static_cast<std::int32_t>(n_normals);
+        auto emit = [&](const Corner &corner, const glm::vec3 &flat_normal) {
+            Corner key = corner;
+            if (key.vn == no_index) {
+                key.vn = next_generated_normal;
+            }
+            bool inserted;
+            const unsigned int index = table.find_or_insert(key, static_cast<unsigned int>(mesh.vertices.size()), inserted);
+            if (inserted) {
+                Vertex vertex;
+                vertex.position = positions[corner.v];
+                vertex.normal = corner.vn == no_index ? flat_normal : normals[corner.vn];
+                if (corner.vt == no_index) {
+                    vertex.tex_coords = glm::vec2(0.0f, 0.0f);
+                } else {
+                    const glm::vec2 &uv = tex_coords[corner.vt];
+                    vertex.tex_coords = glm::vec2(uv.x, 1.0f - uv.y);
+                }
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.indices.push_back(index);
+        };
+
+        for (const auto &chunk : chunks) {
+            std::size_t statement = 0;
+            std::size_t corner = 0;
+            for (std::size_t face = 0; face <= chunk.face_sizes.size(); ++face) {
+                for (; statement < chunk.statements.size() && chunk.statements[statement].n_faces_before == face; ++statement) {
+                    const Statement &s = chunk.statements[statement];
+                    switch (s.type) {
+                        case Statement::Type::MaterialLibrary:
+                            for (const auto &library : split_material_libraries(s.name)) {
+                                for (auto &[name, library_material] : load_material_library(parent_path / library)) {
+                                    materials.emplace(name, std::move(library_material));
+                                }
+                            }
+                            break;
+                        case Statement::Type::UseMaterial: {
+                            finish_mesh();
+                            const auto found = materials.find(s.name);
+                            material = found == materials.end() ? &default_material : &found->second;
+                            break;
+                        }
+                        case Statement::Type::Group:
+                            finish_mesh();
+                            break;
+                    }
+                }
+                if (face == chunk.face_sizes.size()) {
+                    break;
+                }
+
+                const Corner *corners = chunk.corners.data() + corner;
+                const std::uint32_t n_corners = chunk.face_sizes[face];
+                corner += n_corners;
+                for (std::uint32_t i = 0; i < n_corners; ++i) {
+                    const Corner &c = corners[i];
+                    if (c.v < 0 || static_cast<std::size_t>(c.v) >= n_positions ||
+                        (c.vt != no_index && (c.vt < 0 || static_cast<std::size_t>(c.vt) >= n_tex_coords)) ||
+                        (c.vn != no_index && (c.vn < 0 || static_cast<std::size_t>(c.vn) >= n_normals))) {
+                        return false;
+                    }
+                }
+
+                // triangle fan
+                for (std::uint32_t i = 1; i + 1 < n_corners; ++i) {
+                    const Corner &a = corners[0];
+                    const Corner &b = corners[i];
+                    const Corner &c = corners[i + 1];
+                    glm::vec3 flat_normal(0.0f);
+                    if (a.vn == no_index || b.vn == no_index || c.vn == no_index) {
+                        const glm::vec3 n = glm::cross(positions[b.v] - positions[a.v], positions[c.v] - positions[a.v]);
+                        const float length = glm::length(n);
+                        flat_normal = length > 0.0f ? n / length : glm::vec3(0.0f);
+                    }
+                    emit(a, flat_normal);
+                    emit(b, flat_normal);
+                    emit(c, flat_normal);
+                    next_generated_normal++;
+                }
+            }
+        }
+        finish_mesh();
+        return true;
+    }
+
+    static void add_textures(
+        const std::vector<std::string> &maps,
+        TextureType texture_type,
+        const std::filesystem::path &parent_path,
+        MeshData &mesh,
+        std::vector<TextureData> &textures
+    ) {
+        for (const auto &map : maps) {
+            const std::string texture_path = (parent_path / std::filesystem::path(map)).string();
+            std::size_t index = 0;
+            while (index < textures.size() && textures[index].filepath != texture_path) {
+                index++;
+            }
+            if (index == textures.size()) {
+                // texture is decoded later
+                TextureData texture;
+                texture.filepath = texture_path;
+                texture.texture_type = texture_type;
+                textures.push_back(std::move(texture));
+            }
+            mesh.indices_of_textures.push_back(static_cast<unsigned int>(index));
+        }
+    }
+};
@@ -0,0 +1,323 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// frame profiler with CPU scopes and GPU scopes measured by GL_TIMESTAMP queries
+//
+// GPU results are read back frames_in_flight frames later, so the CPU never waits for them;
+// a frame whose queries are still not available by then is dropped instead of stalling
+class Profiler {
+public:
+    struct ScopeTiming {
+        const char *name;
+        int index; // e.g. mesh group number, -1 if unused
+        int depth;
+        double cpu_begin; // milliseconds since the profiler started
+        double cpu_milliseconds;
+        double gpu_begin; // GPU time mapped onto the CPU clock, milliseconds
+        double gpu_milliseconds; // negative for CPU-only scopes
+    };
+
+    static constexpr std::size_t history_size = 240;
+
+    static Profiler &instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    void set_enabled(bool enabled) {
+        this->enabled = enabled;
+    }
+
+    // one GPU scope per mesh group is expensive, so it is opt-in
+    bool is_mesh_timing_enabled() const {
+        return enabled && mesh_timing;
+    }
+
+    void set_mesh_timing(bool mesh_timing) {
+        this->mesh_timing = mesh_timing;
+    }
+
+    void begin_frame() {
+        if (!enabled) {
+            return ;
+        }
+        frame_number++;
+        Frame &frame = frames[frame_number % frames_in_flight];
+        resolve(frame);
+
+        frame.scopes.clear();
+        frame.n_used_queries = 0;
+        frame.cpu_begin = now();
+        frame.gpu_begin_query = timestamp(frame);
+        // relate the GPU clock to the CPU clock once per frame for the trace view
+        GLint64 gpu_now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        frame.clock_offset = frame.cpu_begin - gpu_now / 1.0e6;
+        frame.recording = true;
+        depth = 0;
+    }
+
+    void end_frame() {
+        if (!enabled) {
+            return ;
+        }
+        Frame &frame = current();
+        if (!frame.recording) {
+            return ;
+        }
+        frame.gpu_end_query = timestamp(frame);
+        frame.cpu_end = now();
+        frame.recording = false;
+    }
+
+    // returns a handle for end_scope, or -1 when nothing is recorded
+    int begin_scope(const char *name, bool gpu, int index = -1) {
+        if (!enabled) {
+            return -1;
+        }
+        Frame &frame = current();
+        if (!frame.recording) {
+            return -1;
+        }
+        Scope scope;
+        scope.name = name;
+        scope.index = index;
+        scope.depth = depth++;
+        scope.cpu_begin = now();
+        scope.gpu_begin_query = gpu ? timestamp(frame) : -1;
+        frame.scopes.push_back(scope);
+        return static_cast<int>(frame.scopes.size()) - 1;
+    }
+
+    void end_scope(int handle) {
+        if (handle < 0) {
+            return ;
+        }
+        Frame &frame = current();
+        if (!frame.recording) {
+            return ;
+        }
+        Scope &scope = frame.scopes[handle];
+        scope.cpu_end = now();
+        if (scope.gpu_begin_query >= 0) {
+            scope.gpu_end_query = timestamp(frame);
+        }
+        depth--;
+    }
+
+    // scopes of the newest frame whose GPU results are available
+    const std::vector<ScopeTiming> &get_last_scopes() const {
+        return last_scopes;
+    }
+
+    const std::vector<float> &get_cpu_frame_history() const {
+        return cpu_frame_history;
+    }
+
+    const std::vector<float> &get_gpu_frame_history() const {
+        return gpu_frame_history;
+    }
+
+    // most expensive GPU scopes with the given name in the last resolved frame
+    std::vector<ScopeTiming> top_scopes(const char *name, std::size_t n) const {
+        std::vector<ScopeTiming> result;
+        for (const auto &scope : last_scopes) {
+            if (scope.gpu_milliseconds >= 0.0 && std::string(scope.name) == name) {
+                result.push_back(scope);
+            }
+        }
+        std::sort(result.begin(), result.end(), [](const ScopeTiming &a, const ScopeTiming &b) {
+            return a.gpu_milliseconds > b.gpu_milliseconds;
+        });
+        if (result.size() > n) {
+            result.resize(n);
+        }
+        return result;
+    }
+
+    // Chrome trace event format (chrome://tracing, Perfetto) of the recent resolved frames
+    bool write_chrome_trace(const std::string &filepath) const {
+        std::ofstream file(filepath);
+        if (!file.is_open()) {
+            std::cerr << "[Profiler] failed to open " << filepath << std::endl;
+            return false;
+        }
+
+        file << "{\"traceEvents\": [\n";
+        file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+        file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+        for (const auto &frame : trace) {
+            for (const auto &scope : frame) {
+                const std::string name = scope.index >= 0 ? std::string(scope.name) + " " + std::to_string(scope.index) : scope.name;
+                file << ",\n{\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1"
+                    << ", \"ts\": " << scope.cpu_begin * 1000.0 << ", \"dur\": " << scope.cpu_milliseconds * 1000.0 << "}";
+                if (scope.gpu_milliseconds >= 0.0) {
+                    file << ",\n{\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": 2"
+                        << ", \"ts\": " << scope.gpu_begin * 1000.0 << ", \"dur\": " << scope.gpu_milliseconds * 1000.0 << "}";
+                }
+            }
+        }
+        file << "\n]}\n";
+        std::cout << "[Profiler] wrote " << trace.size() << " frames to " << filepath << std::endl;
+        return true;
+    }
+
+    void destroy() {
+        for (auto &frame : frames) {
+            if (!frame.queries.empty()) {
+                glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+            }
+            frame.queries.clear();
+            frame.scopes.clear();
+            frame.recording = false;
+        }
+    }
+
+private:
+    static constexpr std::size_t frames_in_flight = 3;
+    static constexpr std::size_t trace_frames = 300;
+
+    struct Scope {
+        const char *name;
+        int index;
+        int depth;
+        double cpu_begin;
+        double cpu_end = 0.0;
+        int gpu_begin_query;
+        int gpu_end_query = -1;
+    };
+
+    struct Frame {
+        std::vector<GLuint> queries;
+        std::size_t n_used_queries = 0;
+        std::vector<Scope> scopes;
+        double cpu_begin = 0.0;
+        double cpu_end = 0.0;
+        double clock_offset = 0.0;
+        int gpu_begin_query = -1;
+        int gpu_end_query = -1;
+        bool recording = false;
+    };
+
+    bool enabled = true;
+    bool mesh_timing = false;
+    std::uint64_t frame_number = 0;
+    int depth = 0;
+    Frame frames[frames_in_flight];
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<ScopeTiming> last_scopes;
+    std::vector<float> cpu_frame_history;
+    std::vector<float> gpu_frame_history;
+    std::deque<std::vector<ScopeTiming>> trace;
+
+    Profiler() { }
+
+    Frame &current() {
+        return frames[frame_number % frames_in_flight];
+    }
+
+    double now() const {
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    int timestamp(Frame &frame) {
+        if (frame.n_used_queries == frame.queries.size()) {
+            frame.queries.push_back(0);
+            glGenQueries(1, &frame.queries.back());
+        }
+        glQueryCounter(frame.queries[frame.n_used_queries], GL_TIMESTAMP);
+        return static_cast<int>(frame.n_used_queries++);
+    }
+
+    double gpu_milliseconds(const Frame &frame, int query) const {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(frame.queries[query], GL_QUERY_RESULT, &nanoseconds);
+        return nanoseconds / 1.0e6;
+    }
+
+    // read back a frame recorded frames_in_flight frames ago
+    void resolve(Frame &frame) {
+        if (frame.recording || frame.gpu_end_query < 0) {
+            frame.gpu_end_query = -1;
+            return ;
+        }
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(frame.queries[frame.gpu_end_query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) {
+            frame.gpu_end_query = -1;
+            return ;
+        }
+
+        const double gpu_begin = gpu_milliseconds(frame, frame.gpu_begin_query);
+        const double gpu_end = gpu_milliseconds(frame, frame.gpu_end_query);
+        push_history(cpu_frame_history, static_cast<float>(frame.cpu_end - frame.cpu_begin));
+        push_history(gpu_frame_history, static_cast<float>(gpu_end - gpu_begin));
+
+        last_scopes.clear();
+        for (const auto &scope : frame.scopes) {
+            ScopeTiming timing;
+            timing.name = scope.name;
+            timing.index = scope.index;
+            timing.depth = scope.depth;
+            timing.cpu_begin = scope.cpu_begin;
+            timing.cpu_milliseconds = scope.cpu_end - scope.cpu_begin;
+            timing.gpu_begin = 0.0;
+            timing.gpu_milliseconds = -1.0;
+            if (scope.gpu_begin_query >= 0 && scope.gpu_end_query >= 0) {
+                const double begin = gpu_milliseconds(frame, scope.gpu_begin_query);
+                timing.gpu_begin = begin + frame.clock_offset;
+                timing.gpu_milliseconds = gpu_milliseconds(frame, scope.gpu_end_query) - begin;
+            }
+            last_scopes.push_back(timing);
+        }
+
+        trace.push_back(last_scopes);
+        if (trace.size() > trace_frames) {
+            trace.pop_front();
+        }
+        frame.gpu_end_query = -1;
+    }
+
+    static void push_history(std::vector<float> &history, float value) {
+        if (history.size() == history_size) {
+            history.erase(history.begin());
+        }
+        history.push_back(value);
+    }
+};
+
+// CPU scope, optionally also measured on the GPU, for the lifetime of the object
+class ProfileScope {
+public:
+    ProfileScope(const char *name, bool gpu = false, int index = -1) :
+        handle(Profiler::instance().begin_scope(name, gpu, index)) { }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+    ~ProfileScope() {
+        Profiler::instance().end_scope(handle);
+    }
+
+private:
+    int handle;
+};
@@ -0,0 +1,219 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <zmv/hash.h>
+
+// on-disk cache of linked program binaries (ARB_get_program_binary), keyed by the shader sources
+// and the driver; a binary of another driver or driver version is never looked up, one the driver
+// still rejects is deleted and rebuilt
+//
+// also turns on KHR_parallel_shader_compile, with which compiles and links issued back to back run
+// on driver threads until their status is queried, see Shader::finish
+class ProgramCache {
+public:
+    ProgramCache(const ProgramCache &) = delete;
+    ProgramCache &operator=(const ProgramCache &) = delete;
+
+    // the first call needs a current GL context
+    static ProgramCache &instance() {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    bool is_supported() const {
+        return supported;
+    }
+
+    bool is_parallel_compile_supported() const {
+        return parallel_compile;
+    }
+
+    std::uint64_t make_key(const std::string &vertex_source, const std::string &fragment_source) const {
+        return Hash()
+            .add(vertex_source)
+            .add(fragment_source)
+            .add(driver)
+            .add(version)
+            .digest();
+    }
+
+    // links program from a cached binary, false on a miss
+    bool load(std::uint64_t key, GLuint program) {
+        if (!supported) {
+            return false;
+        }
+#ifdef GL_ARB_get_program_binary
+        const std::string filepath = cache_filepath(key);
+        std::ifstream file(filepath, std::ios::binary);
+        if (!file.is_open()) {
+            n_misses++;
+            return false;
+        }
+
+        Header header;
+        std::vector<char> binary;
+        bool valid = file.read(reinterpret_cast<char*>(&header), sizeof(Header)) &&
+            std::memcmp(header.magic, magic, sizeof(header.magic)) == 0 &&
+            header.version == version &&
+            header.key == key &&
+            header.size > 0;
+        if (valid) {
+            binary.resize(header.size);
+            valid = file.read(binary.data(), binary.size()) &&
+                Hash().add(binary.data(), binary.size()).digest() == header.checksum;
+        }
+        file.close();
+
+        if (valid) {
+            glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+            GLint linked = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            valid = linked == GL_TRUE;
+        }
+        if (!valid) {
+            std::cerr << "[ProgramCache] dropping invalid entry " << filepath << std::endl;
+            std::error_code ec;
+            std::filesystem::remove(filepath, ec);
+            n_misses++;
+            return false;
+        }
+        n_hits++;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // program must be linked, with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before linking
+    void store(std::uint64_t key, GLuint program) const {
+        if (!supported) {
+            return ;
+        }
+#ifdef GL_ARB_get_program_binary
+        GLint size = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0) {
+            return ;
+        }
+        std::vector<char> binary(size);
+        GLsizei length = 0;
+        GLenum format = 0;
+        glGetProgramBinary(program, size, &length, &format, binary.data());
+        binary.resize(length);
+
+        Header header;
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.format = format;
+        header.key = key;
+        header.size = binary.size();
+        header.checksum = Hash().add(binary.data(), binary.size()).digest();
+
+        std::error_code ec;
+        std::filesystem::create_directories(cache_directory, ec);
+
+        // same temporary file + rename scheme as MeshCache
+        const std::string final_path = cache_filepath(key);
+        const std::string temporary_path = final_path + ".tmp";
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[ProgramCache] failed to open " << temporary_path << std::endl;
+            return ;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(binary.data(), binary.size());
+        file.close();
+
+        if (!file) {
+            std::cerr << "[ProgramCache] failed to write " << temporary_path << std::endl;
+            std::filesystem::remove(temporary_path, ec);
+            return ;
+        }
+        std::filesystem::rename(temporary_path, final_path, ec);
+        if (ec) {
+            std::cerr << "[ProgramCache] failed to write " << final_path << ": " << ec.message() << std::endl;
+            std::filesystem::remove(temporary_path, ec);
+        }
+#endif
+    }
+
+    std::size_t get_hit_count() const {
+        return n_hits;
+    }
+
+    std::size_t get_miss_count() const {
+        return n_misses;
+    }
+
+private:
+    static constexpr char magic[4] = {'Z', 'M', 'V', 'P'};
+    static constexpr std::uint32_t version = 1;
+
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t format;
+        std::uint32_t padding = 0;
+        std::uint64_t key;
+        std::uint64_t size;
+        std::uint64_t checksum;
+    };
+
+    std::string cache_directory;
+    // vendor, renderer and version strings; binaries are only valid for the driver that made them
+    std::string driver;
+    bool supported = false;
+    bool parallel_compile = false;
+    std::size_t n_hits = 0;
+    std::size_t n_misses = 0;
+
+    ProgramCache(const std::string &cache_directory = ".zmv_cache/programs") :
+        cache_directory(cache_directory) {
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const char *str = reinterpret_cast<const char*>(glGetString(name));
+            driver += str ? str : "";
+            driver += '\n';
+        }
+
+#ifdef GL_ARB_get_program_binary
+        GLint n_formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+        supported = has_extension("GL_ARB_get_program_binary") && n_formats > 0;
+#endif
+        if (!supported) {
+            std::cout << "[ProgramCache] program binaries are not supported, shaders are compiled on every start" << std::endl;
+        }
+
+#ifdef GL_KHR_parallel_shader_compile
+        parallel_compile = has_extension("GL_KHR_parallel_shader_compile");
+        if (parallel_compile) {
+            // as many threads as the driver likes
+            glMaxShaderCompilerThreadsKHR(0xffffffff);
+        }
+#endif
+    }
+
+    static bool has_extension(const char *extension) {
+        GLint n_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+        for (GLint i = 0; i < n_extensions; ++i) {
+            const char *name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && std::strcmp(name, extension) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string cache_filepath(std::uint64_t key) const {
+        return (std::filesystem::path(cache_directory) / (Hash().add(key).hex() + ".zmvprog")).string();
+    }
+};
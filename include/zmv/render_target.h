@@ -0,0 +1,138 @@
+#pragma once
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include <zmv/gl_object.h>
+
+// offscreen color and depth target that keeps the last model render, so that frames in which
+// nothing changed only copy it to the window instead of drawing the scene again;
+// a target smaller than the window is resolved into a texture and upscaled, see Renderer::upscale
+class RenderTarget {
+public:
+    bool create(int width, int height, int samples) {
+        destroy();
+        this->width = width;
+        this->height = height;
+        this->samples = samples;
+
+        framebuffer.create();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        color.create();
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+        depth.create();
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            std::cerr << "[RenderTarget] framebuffer is incomplete" << std::endl;
+            destroy();
+        }
+        return complete;
+    }
+
+    void destroy() {
+        color.reset();
+        depth.reset();
+        framebuffer.reset();
+        resolve_color.reset();
+        resolve_framebuffer.reset();
+        resolved = false;
+        width = 0;
+        height = 0;
+    }
+
+    operator bool() const {
+        return framebuffer != 0;
+    }
+
+    bool matches(int width, int height, int samples) const {
+        return framebuffer != 0 && this->width == width && this->height == height && this->samples == samples;
+    }
+
+    int get_width() const {
+        return width;
+    }
+
+    int get_height() const {
+        return height;
+    }
+
+    // for drawing, the resolved texture is out of date afterwards
+    void bind() {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        resolved = false;
+    }
+
+    // copies the color to a single-sampled framebuffer of the same size, resolving multisampling
+    void blit_to(GLuint target_framebuffer) const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_framebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target_framebuffer);
+    }
+
+    // single-sampled copy of the color with bilinear filtering, created on first use and only
+    // resolved again after the target was drawn to; 0 if it could not be created
+    GLuint resolve() {
+        if (!resolve_framebuffer) {
+            resolve_framebuffer.create();
+            glBindFramebuffer(GL_FRAMEBUFFER, resolve_framebuffer);
+            resolve_color.create();
+            glBindTexture(GL_TEXTURE_2D, resolve_color);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolve_color, 0);
+            const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            if (!complete) {
+                std::cerr << "[RenderTarget] resolve framebuffer is incomplete" << std::endl;
+                resolve_color.reset();
+                resolve_framebuffer.reset();
+                return 0;
+            }
+        }
+        if (!resolved) {
+            blit_to(resolve_framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            resolved = true;
+        }
+        return resolve_color;
+    }
+
+    // bilinear blit of the resolved color to a framebuffer of another size, for when the
+    // upscale program is not built yet
+    void blit_resolved_to(GLuint target_framebuffer, int target_width, int target_height) {
+        if (resolve() == 0) {
+            return ;
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, resolve_framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_framebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, target_width, target_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, target_framebuffer);
+    }
+
+private:
+    int width = 0;
+    int height = 0;
+    int samples = 0;
+    GLFramebuffer framebuffer;
+    GLRenderbuffer color;
+    GLRenderbuffer depth;
+    GLFramebuffer resolve_framebuffer;
+    GLTexture resolve_color;
+    bool resolved = false;
+};
@@ -1,8 +1,19 @@
 #pragma once
 #include <zmv/camera.h>
+#include <zmv/draw_queue.h>
+#include <zmv/frame_stats.h>
+#include <zmv/frustum.h>
+#include <zmv/gbuffer.h>
+#include <zmv/gl_state_cache.h>
+#include <zmv/lod_selector.h>
 #include <zmv/model.h>
-#include <zmv/shader.h>
+#include <zmv/model_loader.h>
+#include <zmv/profiler.h>
+#include <zmv/scene.h>
+#include <zmv/shader_library.h>
 #include <zmv/texture.h>
+#include <zmv/texture_cache.h>
+#include <zmv/uniform_ring.h>
 
 enum class RenderMode {
     Position, Normal, TexCoords, Diffuse, Specular
@@ -17,62 +28,245 @@ class Renderer {
 public: 
     Renderer(int width, int height) :
         width(width), height(height),
-        render_mode(RenderMode::Normal),
-        position_shader{"shaders/shader.vert", "shaders/position.frag"},
-        normal_shader{"shaders/shader.vert", "shaders/normal.frag"},
-        texCoords_shader{"shaders/shader.vert", "shaders/texcoords.frag"},
-        diffuse_shader{"shaders/shader.vert", "shaders/diffuse.frag"},
-        specular_shader{"shaders/shader.vert", "shaders/specular.frag"} 
+        render_mode(RenderMode::Normal)
     {
-        camera_block.view = camera.compute_view_matrix();
-        camera_block.projection = camera.compute_projection_matrix(width, height);
+        // programs are built on first use, see ShaderLibrary
+        shaders.set_setup(setup_shader);
 
-        glGenBuffers(1, &camera_UBO);    
-        glBindBuffer(GL_UNIFORM_BUFFER, camera_UBO);
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), &camera_block, GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-        glBindBufferBase(GL_UNIFORM_BUFFER, 0, camera_UBO);
-        position_shader.set_UBO("CameraBlock", 0);
-        normal_shader.set_UBO("CameraBlock", 0);
-        texCoords_shader.set_UBO("CameraBlock", 0);
-        diffuse_shader.set_UBO("CameraBlock", 0);
-        specular_shader.set_UBO("CameraBlock", 0);
+        persistent_uniforms_supported = UniformRing::is_persistent_supported();
+        if (!persistent_uniforms_supported) {
+            std::cout << "[Renderer] ARB_buffer_storage is not supported, per-frame uniforms are uploaded with glBufferSubData" << std::endl;
+        }
+        uniform_ring.create(uniform_ring_size, persistent_uniforms_supported);
+        // the fullscreen triangle has no attributes, but core profiles need a VAO to draw
+        fullscreen_VAO.create();
+
+        const bool compression_supported = TextureCompressor::is_supported();
+        if (!compression_supported) {
+            std::cout << "[Renderer] S3TC texture compression is not supported, textures are uploaded as RGB8" << std::endl;
+        }
+        TextureCache::instance().set_compression_supported(compression_supported);
     }
 
     void render() {
-        // render model
-        switch (render_mode) {
-            case RenderMode::Position:
-                model.draw(position_shader);
-                break;
-            case RenderMode::Normal:
-                model.draw(normal_shader);
-                break;
-            case RenderMode::TexCoords:
-                model.draw(texCoords_shader);
-                break;
-            case RenderMode::Diffuse:
-                model.draw(diffuse_shader);
-                break;
-            case RenderMode::Specular:
-                model.draw(specular_shader);
-                break;
+        redraw = false;
+        FrameStats::current().reset();
+        ProfileScope scope("model", true);
+
+        // camera changes of the frame are applied once, camera_block is what the shaders see
+        if (camera_dirty) {
+            camera_block.view = camera.compute_view_matrix();
+            camera_block.projection = camera.compute_projection_matrix(width, height);
+            camera_dirty = false;
+            gbuffer_dirty = true;
         }
+
+        // state changed outside of the queue, e.g. by ImGui or uploads, is not tracked
+        gl_state.invalidate();
+        if (deferred) {
+            render_deferred();
+        } else {
+            draw_scene(current_pass());
+        }
+
+        frame_stats = FrameStats::current();
     }
 
+    // loads in the background, the current scene keeps being rendered until the new model is ready
+    // and then replaced by it
     void load_model(const std::string &filepath) {
-        if (model) {
-            model.destroy();
+        model_loader.request(filepath, load_options);
+        loading_filepath = filepath;
+        replace_scene = true;
+    }
+
+    // the same, but the model is added next to the ones already in the scene
+    void add_model(const std::string &filepath) {
+        model_loader.request(filepath, load_options);
+        loading_filepath = filepath;
+        replace_scene = false;
+    }
+
+    // per-frame GL side work that is not drawing, e.g. uploading a model that finished loading
+    void update() {
+        ProfileScope scope("upload");
+        Model loaded;
+        if (model_loader.update(loaded, upload_budget_milliseconds)) {
+            if (replace_scene) {
+                scene.clear();
+            }
+            scene.add(loading_filepath, std::move(loaded));
+            scene_changed();
+        }
+
+        // programs that finished building or were reloaded change the image
+        if (shaders.update()) {
+            scene_changed();
+        }
+
+        // a frame that reused the last image still needs its texture levels
+        if (!scene_drawn) {
+            scene.request_textures();
+        }
+        scene_drawn = false;
+
+        // mip levels streamed in or out change the image
+        TextureCache &texture_cache = TextureCache::instance();
+        const TextureStreamer &streamer = texture_cache.get_streamer();
+        const std::size_t n_streamed_bytes = streamer.get_streamed_bytes() + streamer.get_dropped_bytes();
+        texture_cache.update_streaming();
+        if (streamer.get_streamed_bytes() + streamer.get_dropped_bytes() != n_streamed_bytes) {
+            scene_changed();
+        }
+    }
+
+    // whether the next render() would differ from the last one; callers may keep the last image
+    // otherwise, update() still has to run every frame
+    bool needs_redraw() const {
+        return redraw || camera_dirty;
+    }
+
+    // background work that changes the image once it is done: a model or texture levels loading,
+    // or texture requests of the last render() that the next update() starts loading
+    bool is_busy() const {
+        const TextureStreamer &streamer = TextureCache::instance().get_streamer();
+        return model_loader.is_loading() || scene_drawn || streamer.get_job_count() > 0 || streamer.get_pending_bytes() > 0 ||
+            shaders.get_pending_count() > 0;
+    }
+
+    // draws a color texture of the given size over the current viewport with a Catmull-Rom
+    // filter, for a model rendered below the window resolution; false while the program is building
+    bool upscale(GLuint texture, int source_width, int source_height) {
+        const Shader *upscale_shader = shaders.get(ShaderPass::Upscale, 0);
+        if (!upscale_shader || texture == 0) {
+            return false;
+        }
+        gl_state.invalidate();
+        gl_state.use_program(upscale_shader->get_program());
+        upscale_shader->set_uniform(Uniform::SourceSize, glm::vec2(source_width, source_height));
+        gl_state.bind_texture(0, texture);
+        gl_state.bind_vertex_array(fullscreen_VAO);
+        const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        if (depth_test) {
+            glEnable(GL_DEPTH_TEST);
+        }
+        gl_state.bind_vertex_array(0);
+        gl_state.bind_texture(0, 0);
+        gl_state.use_program(0);
+        return true;
+    }
+
+    const ShaderLibrary &get_shaders() const {
+        return shaders;
+    }
+
+    // stress test: n instances of the last loaded model on a grid
+    void spawn_instances(std::size_t n) {
+        if (!scene.empty()) {
+            scene.spawn_grid(scene.size() - 1, n);
+            scene_changed();
         }
-        model.load_model(filepath);
+    }
+
+    // rasterize the scene once into a G-buffer and show the channel of the render mode from it,
+    // the G-buffer is only redrawn when the camera or the scene changed
+    bool get_deferred() const {
+        return deferred;
+    }
+
+    void set_deferred(bool deferred) {
+        this->deferred = deferred;
+        scene_changed();
+    }
+
+    // all channels at once in a 3 x 2 grid instead of the render mode's
+    bool get_split_view() const {
+        return split_view;
+    }
+
+    void set_split_view(bool split_view) {
+        this->split_view = split_view;
+        redraw = true;
+    }
+
+    const Scene &get_scene() const {
+        return scene;
+    }
+
+    const UniformRing &get_uniform_ring() const {
+        return uniform_ring;
+    }
+
+    bool is_persistent_uniforms_supported() const {
+        return persistent_uniforms_supported;
+    }
+
+    // recreates the uniform ring, persistent mapping needs ARB_buffer_storage
+    void set_persistent_uniforms(bool persistent) {
+        uniform_ring.create(uniform_ring_size, persistent && persistent_uniforms_supported);
+    }
+
+    bool is_loading_model() const {
+        return model_loader.is_loading();
+    }
+
+    float get_loading_progress() const {
+        return model_loader.progress();
+    }
+
+    std::string get_loading_status() const {
+        return model_loader.status();
     }
 
     void set_resulution(int width, int height) {
         this->width = width;
         this->height = height;
 
-        camera_block.projection = camera.compute_projection_matrix(width, height);
-        update_camera_UBO();
+        camera_dirty = true;
+    }
+
+    const LoadOptions &get_load_options() const {
+        return load_options;
+    }
+
+    // applies to the next load_model
+    void set_load_options(const LoadOptions &load_options) {
+        this->load_options = load_options;
+    }
+
+    // counters of the last render()
+    const FrameStats &get_frame_stats() const {
+        return frame_stats;
+    }
+
+    bool get_frustum_culling() const {
+        return frustum_culling;
+    }
+
+    void set_frustum_culling(bool frustum_culling) {
+        this->frustum_culling = frustum_culling;
+        redraw = true;
+    }
+
+    // -1 selects LODs by screen space error
+    int get_forced_lod() const {
+        return forced_lod;
+    }
+
+    void set_forced_lod(int forced_lod) {
+        this->forced_lod = forced_lod;
+        scene_changed();
+    }
+
+    float get_lod_error_pixels() const {
+        return lod_error_pixels;
+    }
+
+    void set_lod_error_pixels(float lod_error_pixels) {
+        this->lod_error_pixels = lod_error_pixels;
+        scene_changed();
     }
 
     RenderMode get_render_mode() const {
@@ -81,6 +275,7 @@ public:
 
     void set_render_mode(const RenderMode &render_mode) {
         this->render_mode = render_mode;
+        redraw = true;
     }
 
     float get_camera_fov() const {
@@ -90,8 +285,7 @@ public:
     void set_camera_fov(float fov) {
         camera.fov = fov;
 
-        camera_block.projection = camera.compute_projection_matrix(width, height);
-        update_camera_UBO();
+        camera_dirty = true;
     } 
 
     float get_camera_movement_speed() const {
@@ -104,13 +298,13 @@ public:
 
     void reset_camera() {
         camera.reset();
+        camera_dirty = true;
     }
 
     void move_camera(const CameraMovement &direction, float deltaTime) {
         camera.move(direction, deltaTime);
 
-        camera_block.view = camera.compute_view_matrix();
-        update_camera_UBO();
+        camera_dirty = true;
     }
 
     float get_camera_look_around_speed() const {
@@ -124,17 +318,17 @@ public:
     void look_around_camera(float dPhi, float dTheta) {
         camera.look_around(dPhi, dTheta);
 
-        camera_block.view = camera.compute_view_matrix();
-        update_camera_UBO();
+        camera_dirty = true;
     }
 
     void destroy() {
-        glDeleteBuffers(1, &camera_UBO);
-        model.destroy();
-        position_shader.destroy();
-        normal_shader.destroy();
-        diffuse_shader.destroy();
-        specular_shader.destroy();
+        model_loader.cancel();
+        uniform_ring.destroy();
+        scene.clear();
+        TextureCache::instance().clear();
+        shaders.destroy();
+        gbuffer.destroy();
+        fullscreen_VAO.reset();
     }
 
 private:
@@ -142,20 +336,172 @@ private:
     int height;
     RenderMode render_mode;
     Camera camera;
-    Model model;
+    Scene scene;
+    ModelLoader model_loader;
+    std::string loading_filepath;
+    bool replace_scene = true;
+    DrawQueue draw_queue;
+    GLStateCache gl_state;
+    LoadOptions load_options;
+    FrameStats frame_stats;
+    bool frustum_culling = true;
+    int forced_lod = -1;
+    // largest simplification error allowed on screen
+    float lod_error_pixels = 1.0f;
+    // time spent per frame on uploading a model that finished loading
+    static constexpr double upload_budget_milliseconds = 4.0;
+
+    ShaderLibrary shaders;
 
-    Shader position_shader;
-    Shader normal_shader;
-    Shader texCoords_shader;
-    Shader diffuse_shader;
-    Shader specular_shader;
+    // deferred path, created on first use
+    bool deferred = false;
+    bool split_view = false;
+    GBuffer gbuffer;
+    bool gbuffer_dirty = true;
 
-    GLuint camera_UBO;
+    // see needs_redraw, scene_drawn tells update() whether the last frame requested textures
+    bool redraw = true;
+    bool scene_drawn = false;
+    GLVertexArray fullscreen_VAO;
+
+    // per-frame data: camera block and instance matrices
+    static constexpr std::size_t uniform_ring_size = 64 * 1024;
+    UniformRing uniform_ring;
+    bool persistent_uniforms_supported = false;
     CameraBlock camera_block;
+    // the camera moved since camera_block was computed
+    bool camera_dirty = true;
+
+    // bindings that never change after linking
+    static void setup_shader(ShaderPass pass, const Shader &shader) {
+        if (pass == ShaderPass::Upscale) {
+            shader.activate();
+            shader.set_uniform(Uniform::Source, 0);
+            shader.deactivate();
+            return ;
+        }
+        if (pass == ShaderPass::GBufferView) {
+            GLint gbuffer_units[GBuffer::n_channels];
+            for (int i = 0; i < GBuffer::n_channels; ++i) {
+                gbuffer_units[i] = i;
+            }
+            shader.activate();
+            shader.set_uniform(Uniform::GBuffer, gbuffer_units, GBuffer::n_channels);
+            shader.deactivate();
+            return ;
+        }
 
-    void update_camera_UBO() {
-        glBindBuffer(GL_UNIFORM_BUFFER, camera_UBO);
-        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), &camera_block, GL_DYNAMIC_DRAW);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        shader.set_UBO("CameraBlock", camera_block_binding);
+        shader.set_UBO("MaterialBlock", material_block_binding);
+
+        GLint units[max_material_textures];
+        for (int i = 0; i < max_material_textures; ++i) {
+            units[i] = i;
+        }
+        shader.activate();
+        shader.set_uniform(Uniform::MaterialTextures, units, max_material_textures);
+        shader.deactivate();
+    }
+
+    // culls, sorts and draws the scene with one program, per-frame data goes through the uniform ring
+    void draw_scene(ShaderPass pass) {
+        // same matrices as the camera block, so culling always matches what is drawn
+        const glm::mat4 view_projection = camera_block.projection * camera_block.view;
+        const Frustum frustum = Frustum::from_matrix(view_projection);
+        const Frustum *culling_frustum = frustum_culling ? &frustum : nullptr;
+        LodSelector lod_selector = LodSelector::from_camera(camera_block.view, camera_block.projection, height);
+        lod_selector.max_error_pixels = lod_error_pixels;
+        lod_selector.forced_level = forced_lod;
+
+        draw_queue.clear();
+
+        // everything that changes per frame goes to the uniform ring, uploaded once
+        GLintptr camera_offset;
+        {
+            ProfileScope uniform_scope("uniform setup");
+            uniform_ring.begin_frame(uniform_ring.aligned_size(sizeof(CameraBlock)) + scene.frame_bytes(uniform_ring));
+            camera_offset = uniform_ring.write(&camera_block, 1);
+        }
+
+        scene.submit(draw_queue, shaders, pass, uniform_ring, view_projection, culling_frustum, lod_selector);
+        uniform_ring.flush();
+        gl_state.bind_uniform_range(camera_block_binding, uniform_ring.get_buffer(), camera_offset, sizeof(CameraBlock));
+        draw_queue.execute(gl_state);
+        uniform_ring.end_frame();
+        FrameStats::current().uniform_bytes = uniform_ring.get_frame_bytes();
+        scene_drawn = true;
+    }
+
+    // what is drawn changed, not only how it is shown
+    void scene_changed() {
+        gbuffer_dirty = true;
+        redraw = true;
+    }
+
+    void render_deferred() {
+        FrameStats &stats = FrameStats::current();
+
+        // the caller's target, e.g. the window or the benchmark's framebuffer
+        GLint target_framebuffer = 0;
+        GLint viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target_framebuffer);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        if (!gbuffer || gbuffer.get_width() != width || gbuffer.get_height() != height) {
+            if (!gbuffer.create(width, height)) {
+                return ;
+            }
+            gbuffer_dirty = true;
+        }
+        if (gbuffer_dirty) {
+            ProfileScope gbuffer_scope("gbuffer", true);
+            gbuffer.begin_pass();
+            draw_scene(ShaderPass::GBuffer);
+            gbuffer_dirty = false;
+            stats.gbuffer_passes++;
+        }
+
+        ProfileScope view_scope("gbuffer view", true);
+        glBindFramebuffer(GL_FRAMEBUFFER, target_framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        const Shader *gbuffer_view_shader = shaders.get(ShaderPass::GBufferView, 0);
+        if (!gbuffer_view_shader) {
+            return ;
+        }
+
+        gl_state.reset_counters();
+        gl_state.use_program(gbuffer_view_shader->get_program());
+        gbuffer_view_shader->set_uniform(Uniform::GBufferChannel, split_view ? -1 : static_cast<GLint>(render_mode));
+        for (int i = 0; i < GBuffer::n_channels; ++i) {
+            gl_state.bind_texture(static_cast<GLuint>(i), gbuffer.get_texture(i));
+        }
+        gl_state.bind_vertex_array(fullscreen_VAO);
+        const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        if (depth_test) {
+            glEnable(GL_DEPTH_TEST);
+        }
+        gl_state.bind_vertex_array(0);
+        gl_state.use_program(0);
+        stats.draw_calls++;
+        stats.state_changes += gl_state.get_issued_count();
+        stats.state_changes_requested += gl_state.get_requested_count();
+    }
+
+    ShaderPass current_pass() const {
+        switch (render_mode) {
+            case RenderMode::Position:
+                return ShaderPass::Position;
+            case RenderMode::Normal:
+                return ShaderPass::Normal;
+            case RenderMode::TexCoords:
+                return ShaderPass::TexCoords;
+            case RenderMode::Diffuse:
+                return ShaderPass::Diffuse;
+            case RenderMode::Specular:
+                return ShaderPass::Specular;
+        }
+        return ShaderPass::Normal;
     }
 };
\ No newline at end of file
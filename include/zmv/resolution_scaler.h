@@ -0,0 +1,190 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+
+#include <glad/glad.h>
+
+// dynamic resolution: scales the size the model is rendered at so that its GPU time fits a
+// frame time budget, the result is upscaled to the window (Renderer::upscale)
+//
+// the model pass is timed with GL_TIME_ELAPSED queries that are read back frames later, never
+// waiting for the GPU; GPU time is taken to grow with the pixel count, i.e. with scale squared.
+// the scale drops right away when a frame is over budget and grows one step at a time when the
+// next step is predicted to fit with some headroom, so that it does not oscillate
+class ResolutionScaler {
+public:
+    static constexpr float min_scale = 0.25f;
+    static constexpr float scale_step = 0.05f;
+
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    // disabled renders at full resolution
+    void set_enabled(bool enabled) {
+        this->enabled = enabled;
+        reset();
+    }
+
+    float get_target_fps() const {
+        return target_fps;
+    }
+
+    void set_target_fps(float target_fps) {
+        this->target_fps = std::max(target_fps, 1.0f);
+        n_samples = 0;
+        total_milliseconds = 0.0;
+    }
+
+    float get_scale() const {
+        return enabled ? scale : 1.0f;
+    }
+
+    // average GPU time of the model pass at the current scale, negative before the first sample
+    double get_gpu_milliseconds() const {
+        return gpu_milliseconds;
+    }
+
+    // the size to render at for a window of width x height, at least 1 x 1
+    int scaled(int size) const {
+        return std::max(1, static_cast<int>(std::lround(size * get_scale())));
+    }
+
+    // around the model pass of a frame that draws it; a frame is not timed when the query
+    // ring is full, i.e. when the GPU is more than n_queries frames behind
+    void begin_pass() {
+        if (!enabled) {
+            return ;
+        }
+        if (!created) {
+            glGenQueries(n_queries, queries.data());
+            created = true;
+        }
+        Query &query = slots[next_slot];
+        if (query.pending) {
+            return ;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[next_slot]);
+        query.pending = true;
+        query.scale = scale;
+        timing = true;
+    }
+
+    void end_pass() {
+        if (!timing) {
+            return ;
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        timing = false;
+        next_slot = (next_slot + 1) % n_queries;
+    }
+
+    // reads the finished queries, oldest first, and adjusts the scale; true when it changed
+    bool update() {
+        if (!enabled || !created) {
+            return false;
+        }
+        const float old_scale = scale;
+        for (int i = 0; i < n_queries; ++i) {
+            const int slot = (next_slot + i) % n_queries;
+            Query &query = slots[slot];
+            if (!query.pending) {
+                continue;
+            }
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+            query.pending = false;
+            // a frame rendered at another scale says nothing about this one
+            if (query.scale == scale) {
+                add_sample(nanoseconds / 1.0e6);
+            }
+        }
+        return scale != old_scale;
+    }
+
+    void destroy() {
+        if (created) {
+            glDeleteQueries(n_queries, queries.data());
+            created = false;
+        }
+        reset();
+    }
+
+private:
+    static constexpr int n_queries = 4;
+    // samples averaged before each decision
+    static constexpr int samples_per_decision = 3;
+    // share of the frame time left to the model, the rest is for upscaling, ImGui and the swap
+    static constexpr double model_share = 0.8;
+    // a step up must be predicted to stay below this share of the budget
+    static constexpr double headroom = 0.85;
+
+    struct Query {
+        bool pending = false;
+        float scale = 1.0f;
+    };
+
+    bool enabled = false;
+    float target_fps = 60.0f;
+    float scale = 1.0f;
+    double gpu_milliseconds = -1.0;
+
+    bool created = false;
+    std::array<GLuint, n_queries> queries = {};
+    std::array<Query, n_queries> slots = {};
+    int next_slot = 0;
+    bool timing = false;
+
+    int n_samples = 0;
+    double total_milliseconds = 0.0;
+
+    // queries still in flight are dropped, beginning a query again discards its old result
+    void reset() {
+        slots.fill(Query());
+        scale = 1.0f;
+        gpu_milliseconds = -1.0;
+        n_samples = 0;
+        total_milliseconds = 0.0;
+    }
+
+    void add_sample(double milliseconds) {
+        total_milliseconds += milliseconds;
+        n_samples++;
+        if (n_samples < samples_per_decision) {
+            return ;
+        }
+        gpu_milliseconds = total_milliseconds / n_samples;
+        n_samples = 0;
+        total_milliseconds = 0.0;
+
+        const double budget = model_share * 1000.0 / target_fps;
+        float new_scale = scale;
+        if (gpu_milliseconds > budget) {
+            // the largest step below the scale predicted to fit
+            const double fitting = scale * std::sqrt(budget / gpu_milliseconds);
+            new_scale = static_cast<float>(std::floor(fitting / scale_step) * scale_step);
+            new_scale = std::min(new_scale, scale - scale_step);
+        } else {
+            const float up = scale + scale_step;
+            const double predicted = gpu_milliseconds * (up * up) / (scale * scale);
+            if (up <= 1.0f + 1e-3f && predicted <= headroom * budget) {
+                new_scale = up;
+            }
+        }
+        // keeps the scale on the step grid, so that a scale seen before gives the same size
+        new_scale = std::round(new_scale / scale_step) * scale_step;
+        new_scale = std::clamp(new_scale, min_scale, 1.0f);
+        if (new_scale != scale) {
+            std::cout << "[ResolutionScaler] model pass " << gpu_milliseconds << " ms of " << budget
+                << " ms, scale " << scale << " -> " << new_scale << std::endl;
+            scale = new_scale;
+        }
+    }
+};
@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <zmv/draw_queue.h>
+#include <zmv/frame_stats.h>
+#include <zmv/frustum.h>
+#include <zmv/lod_selector.h>
+#include <zmv/model.h>
+#include <zmv/shader_library.h>
+#include <zmv/uniform_ring.h>
+
+// placement of a model in the scene; no rotation, so bounds, LOD and culling carry over from
+// model space by a translation and a uniform scale
+struct Instance {
+    glm::vec3 position = glm::vec3(0.0f);
+    float scale = 1.0f;
+
+    glm::mat4 matrix() const {
+        glm::mat4 matrix(scale);
+        matrix[3] = glm::vec4(position, 1.0f);
+        return matrix;
+    }
+
+    Bounds transform(const Bounds &bounds) const {
+        Bounds world;
+        world.min = position + scale * bounds.min;
+        world.max = position + scale * bounds.max;
+        world.center = position + scale * bounds.center;
+        world.radius = scale * bounds.radius;
+        return world;
+    }
+};
+
+// models and their instances; all visible instances of one model share its draws, which are
+// issued as instanced draws with one model matrix per instance
+class Scene {
+public:
+    struct Entry {
+        std::string filepath;
+        Model model;
+        std::vector<Instance> instances;
+    };
+
+    std::size_t size() const {
+        return entries.size();
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    const Entry &operator[](std::size_t i) const {
+        return entries[i];
+    }
+
+    std::size_t instance_count() const {
+        std::size_t n = 0;
+        for (const auto &entry : entries) {
+            n += entry.instances.size();
+        }
+        return n;
+    }
+
+    // takes over a loaded model with one instance, placed next to the models already in the scene
+    void add(const std::string &filepath, Model &&model) {
+        Instance instance;
+        if (!entries.empty()) {
+            float max_x = -std::numeric_limits<float>::max();
+            for (const auto &entry : entries) {
+                for (const auto &placed : entry.instances) {
+                    max_x = std::max(max_x, placed.transform(entry.model.get_bounds()).max.x);
+                }
+            }
+            const Bounds &bounds = model.get_bounds();
+            instance.position.x = max_x + 0.1f * bounds.radius - bounds.min.x;
+        }
+        entries.push_back({filepath, std::move(model), {instance}});
+    }
+
+    // replaces the instances of entry i by a grid of n on the xz plane, the first one stays in
+    // place and the grid extends away from the default camera
+    void spawn_grid(std::size_t i, std::size_t n) {
+        if (i >= entries.size() || n == 0) {
+            return ;
+        }
+        Entry &entry = entries[i];
+        const Instance origin = entry.instances.empty() ? Instance() : entry.instances.front();
+        const float spacing = 2.5f * std::max(entry.model.get_bounds().radius * origin.scale, 1e-3f);
+        const std::size_t n_columns = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+
+        entry.instances.resize(n);
+        for (std::size_t j = 0; j < n; ++j) {
+            const std::size_t column = j % n_columns;
+            const std::size_t row = j / n_columns;
+            // columns alternate right and left of the first instance
+            const float x = (column % 2 ? 1.0f : -1.0f) * static_cast<float>((column + 1) / 2);
+            entry.instances[j] = origin;
+            entry.instances[j].position += spacing * glm::vec3(x, 0.0f, -static_cast<float>(row));
+        }
+    }
+
+    // upper bound of what submit() writes into the ring
+    std::size_t frame_bytes(const UniformRing &ring) const {
+        std::size_t n_bytes = 0;
+        for (const auto &entry : entries) {
+            n_bytes += ring.aligned_size(entry.instances.size() * sizeof(glm::mat4));
+        }
+        return n_bytes;
+    }
+
+    // culls instances by their bounding sphere and queues one instanced submission per model,
+    // the matrices of the visible instances go to the ring;
+    // LOD and texture coverage follow the closest visible instance, meshes are only culled
+    // individually when a single instance is visible
+    void submit(DrawQueue &queue, ShaderLibrary &shaders, ShaderPass pass, UniformRing &ring, const glm::mat4 &view_projection,
+                const Frustum *frustum, const LodSelector &lod_selector) {
+        FrameStats &stats = FrameStats::current();
+        for (auto &entry : entries) {
+            const Bounds &bounds = entry.model.get_bounds();
+            visible_matrices.clear();
+            const Instance *closest = nullptr;
+            float closest_distance = std::numeric_limits<float>::max();
+            for (const auto &instance : entry.instances) {
+                const Bounds world = instance.transform(bounds);
+                if (frustum && !frustum->intersects(world.center, world.radius)) {
+                    stats.instances_culled++;
+                    continue;
+                }
+                visible_matrices.push_back(instance.matrix());
+                const float distance = lod_selector.distance(world);
+                if (distance < closest_distance) {
+                    closest_distance = distance;
+                    closest = &instance;
+                }
+            }
+            stats.instances_submitted += visible_matrices.size();
+            if (!closest) {
+                continue;
+            }
+            const GLintptr offset = ring.write(visible_matrices.data(), visible_matrices.size());
+            if (offset < 0) {
+                continue;
+            }
+            entry.model.set_instances(ring.get_buffer(), ring.get_generation(), offset);
+
+            // the camera in model space of the closest instance
+            LodSelector model_lod_selector = lod_selector;
+            model_lod_selector.eye = (lod_selector.eye - closest->position) / closest->scale;
+            model_lod_selector.pixels_per_unit = lod_selector.pixels_per_unit * closest->scale;
+            Frustum model_frustum;
+            const Frustum *mesh_frustum = nullptr;
+            if (frustum && visible_matrices.size() == 1) {
+                model_frustum = Frustum::from_matrix(view_projection * visible_matrices.front());
+                mesh_frustum = &model_frustum;
+            }
+            entry.model.submit(queue, shaders, pass, mesh_frustum, &model_lod_selector, visible_matrices.size());
+        }
+    }
+
+    // see Model::request_textures
+    void request_textures() const {
+        for (const auto &entry : entries) {
+            entry.model.request_textures();
+        }
+    }
+
+    void clear() {
+        for (auto &entry : entries) {
+            entry.model.destroy();
+        }
+        entries.clear();
+    }
+
+private:
+    std::vector<Entry> entries;
+    // per-frame scratch of submit()
+    std::vector<glm::mat4> visible_matrices;
+};
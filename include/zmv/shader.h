@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -11,16 +14,96 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <zmv/frame_stats.h>
+#include <zmv/program_cache.h>
+
+// compile-time handles of uniform names, their locations are looked up once after linking
+enum class Uniform : std::size_t {
+    MaterialTextures,
+    PositionOffset,
+    PositionScale,
+    GBuffer,
+    GBufferChannel,
+    Source,
+    SourceSize,
+    Count
+};
+
+constexpr const char *uniform_names[] = {
+    "materialTextures",
+    "positionOffset",
+    "positionScale",
+    "gbuffer",
+    "gbufferChannel",
+    "source",
+    "sourceSize",
+};
+
+static_assert(sizeof(uniform_names) / sizeof(uniform_names[0]) == static_cast<std::size_t>(Uniform::Count),
+    "every Uniform needs a name");
+
+// the constructor only starts building the program, from the ProgramCache or by compiling and
+// linking without waiting; finish() must be called before the program is used
 class Shader {
 public:
     Shader() { }
+    // defines are inserted after the #version line of both sources, see ShaderLibrary
     Shader(
         const std::string &vertex_shader_filepath,
-        const std::string &fragment_shader_filepath
+        const std::string &fragment_shader_filepath,
+        const std::vector<std::string> &defines = {}
     ) : vertex_shader_filepath(vertex_shader_filepath),
         fragment_shader_filepath(fragment_shader_filepath) {
-        compile_shader();
-        link_shader();
+        vertex_shader_source = add_defines(file_to_string(vertex_shader_filepath), defines);
+        fragment_shader_source = add_defines(file_to_string(fragment_shader_filepath), defines);
+
+        ProgramCache &program_cache = ProgramCache::instance();
+        cache_key = program_cache.make_key(vertex_shader_source, fragment_shader_source);
+        program = glCreateProgram();
+        from_cache = program_cache.load(cache_key, program);
+        if (!from_cache) {
+            compile_shader();
+            link_shader();
+        }
+    }
+
+    // true when finish() would not wait; always true without KHR_parallel_shader_compile, where
+    // the build runs on the GL thread anyway
+    bool is_build_complete() const {
+        if (finished || from_cache || !ProgramCache::instance().is_parallel_compile_supported()) {
+            return true;
+        }
+        GLint complete = GL_TRUE;
+#ifdef GL_KHR_parallel_shader_compile
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+#endif
+        return complete == GL_TRUE;
+    }
+
+    // waits for the program, checks it for errors and stores it in the ProgramCache; starting
+    // every program before finishing the first lets the driver compile them in parallel;
+    // false when compiling or linking failed
+    bool finish() {
+        if (finished) {
+            return valid;
+        }
+        finished = true;
+        if (!from_cache) {
+            const bool vertex_compiled = check_compile_errors(vertex_shader, "vertex shader");
+            const bool fragment_compiled = check_compile_errors(fragment_shader, "fragment shader");
+            valid = vertex_compiled && fragment_compiled && check_compile_errors(program, "program");
+            if (!valid) {
+                std::cerr << "[Shader] failed to build " << vertex_shader_filepath << " + " << fragment_shader_filepath << std::endl;
+            } else {
+                ProgramCache::instance().store(cache_key, program);
+            }
+        }
+        resolve_uniforms();
+        return valid;
+    }
+
+    bool is_from_cache() const {
+        return from_cache;
     }
 
     void destroy() const {
@@ -31,10 +114,12 @@ public:
 
     void activate() const {
         glUseProgram(program);
+        FrameStats::current().state_changes++;
     }
 
     void deactivate() const {
         glUseProgram(0);
+        FrameStats::current().state_changes++;
     }
 
     void set_uniform(
@@ -74,9 +159,49 @@ public:
             }
         };
         std::visit(Visitor{location}, value);
+        FrameStats::current().state_changes++;
         deactivate();
     }
 
+    // fast path, the program must already be active and the uniform may be absent (location -1)
+    void set_uniform(Uniform uniform, GLint value) const {
+        glUniform1i(location(uniform), value);
+        FrameStats::current().state_changes++;
+    }
+
+    void set_uniform(Uniform uniform, GLfloat value) const {
+        glUniform1f(location(uniform), value);
+        FrameStats::current().state_changes++;
+    }
+
+    void set_uniform(Uniform uniform, const glm::vec2 &value) const {
+        glUniform2fv(location(uniform), 1, glm::value_ptr(value));
+        FrameStats::current().state_changes++;
+    }
+
+    void set_uniform(Uniform uniform, const glm::vec3 &value) const {
+        glUniform3fv(location(uniform), 1, glm::value_ptr(value));
+        FrameStats::current().state_changes++;
+    }
+
+    void set_uniform(Uniform uniform, const glm::mat4 &value) const {
+        glUniformMatrix4fv(location(uniform), 1, GL_FALSE, glm::value_ptr(value));
+        FrameStats::current().state_changes++;
+    }
+
+    void set_uniform(Uniform uniform, const GLint *values, GLsizei count) const {
+        glUniform1iv(location(uniform), count, values);
+        FrameStats::current().state_changes++;
+    }
+
+    GLuint get_program() const {
+        return program;
+    }
+
+    GLint location(Uniform uniform) const {
+        return locations[static_cast<std::size_t>(uniform)];
+    }
+
     void set_uniform_texture(
         const std::string &uniform_name,
         GLuint texture,
@@ -91,6 +216,7 @@ public:
         // set texture unit number on uniform variable
         const GLint location = glGetUniformLocation(program, uniform_name.c_str());
         glUniform1i(location, texture_unit_number);
+        FrameStats::current().state_changes += 2;
 
         deactivate();
     }
@@ -100,6 +226,10 @@ public:
         GLuint binding_number
     ) const {
         const GLuint block_index = glGetUniformBlockIndex(program, block_name.c_str());
+        if (block_index == GL_INVALID_INDEX) {
+            // block is not used by this program
+            return ;
+        }
         // set binding number of specified block
         glUniformBlockBinding(program, block_index, binding_number);
     }
@@ -109,9 +239,37 @@ private:
     std::string vertex_shader_source;
     const std::string fragment_shader_filepath;
     std::string fragment_shader_source;
-    GLuint vertex_shader;
-    GLuint fragment_shader;
-    GLuint program;
+    GLuint vertex_shader = 0;
+    GLuint fragment_shader = 0;
+    GLuint program = 0;
+    std::uint64_t cache_key = 0;
+    bool from_cache = false;
+    bool finished = false;
+    bool valid = true;
+    std::array<GLint, static_cast<std::size_t>(Uniform::Count)> locations;
+
+    static std::string add_defines(const std::string &source, const std::vector<std::string> &defines) {
+        if (defines.empty()) {
+            return source;
+        }
+        std::string lines;
+        for (const auto &define : defines) {
+            lines += "#define " + define + "\n";
+        }
+        // #version has to stay the first line
+        const std::size_t version = source.find("#version");
+        const std::size_t line_end = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (line_end == std::string::npos) {
+            return lines + source;
+        }
+        return source.substr(0, line_end + 1) + lines + source.substr(line_end + 1);
+    }
+
+    void resolve_uniforms() {
+        for (std::size_t i = 0; i < locations.size(); ++i) {
+            locations[i] = glGetUniformLocation(program, uniform_names[i]);
+        }
+    }
 
     static std::string file_to_string(const std::string& filepath) {
         std::ifstream file(filepath);
@@ -127,35 +285,36 @@ private:
         return ss.str();
     }
 
+    // errors are checked by finish(), querying them here would wait for the compiler
     void compile_shader() {
         // compile vertex shader
         vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-        vertex_shader_source = file_to_string(vertex_shader_filepath);
         const char *vertex_shader_source_c = vertex_shader_source.c_str();
         glShaderSource(vertex_shader, 1, &vertex_shader_source_c, nullptr);
         glCompileShader(vertex_shader);
-        check_compile_errors(vertex_shader, "vertex shader");
 
         // compile fragment shader
         fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-        fragment_shader_source = file_to_string(fragment_shader_filepath);
         const char *fragment_shader_source_c = fragment_shader_source.c_str();
         glShaderSource(fragment_shader, 1, &fragment_shader_source_c, nullptr);
         glCompileShader(fragment_shader);
-        check_compile_errors(fragment_shader, "fragment shader");
     }
 
     void link_shader() {
-        program = glCreateProgram();
         glAttachShader(program, vertex_shader);
         glAttachShader(program, fragment_shader);
+#ifdef GL_ARB_get_program_binary
+        if (ProgramCache::instance().is_supported()) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+#endif
         glLinkProgram(program);
         glDetachShader(program, vertex_shader);
         glDetachShader(program, fragment_shader);
-        check_compile_errors(program, "program");
     }
 
-    void check_compile_errors(GLuint shader, std::string type) {
+    // the objects of a failed build are kept for destroy()
+    bool check_compile_errors(GLuint shader, std::string type) {
         GLint success;
         GLint log_size = 0;
         if (type != "program") {
@@ -167,7 +326,7 @@ private:
                 std::string error_log_string(error_log.begin(), error_log.end());
                 std::cerr << "failed to compile shader of type: " << type << std::endl;
                 std::cerr << error_log_string << std::endl;
-                glDeleteShader(shader);
+                return false;
             }
         } else {
             glGetProgramiv(shader, GL_LINK_STATUS, &success);
@@ -178,8 +337,9 @@ private:
                 std::string error_log_string(error_log.begin(), error_log.end());
                 std::cerr << "failed to compile program" << std::endl;
                 std::cerr << error_log_string << std::endl;
-                glDeleteProgram(shader);
+                return false;
             }
         }
+        return true;
     }
 };
@@ -0,0 +1,266 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <zmv/shader.h>
+
+// material and vertex features a program can be specialized for, each one is a #define of the
+// same name in the sources; bit i of ShaderFeatures is ShaderFeature i
+enum class ShaderFeature : std::uint32_t {
+    DiffuseTexture,
+    SpecularTexture,
+    CompactVertices,
+    Count
+};
+
+constexpr const char *shader_feature_names[] = {
+    "HAS_DIFFUSE_TEXTURE",
+    "HAS_SPECULAR_TEXTURE",
+    "COMPACT_VERTICES",
+};
+
+static_assert(sizeof(shader_feature_names) / sizeof(shader_feature_names[0]) == static_cast<std::size_t>(ShaderFeature::Count),
+    "every ShaderFeature needs a name");
+
+using ShaderFeatures = std::uint32_t;
+
+constexpr ShaderFeatures feature_bit(ShaderFeature feature) {
+    return ShaderFeatures(1) << static_cast<std::uint32_t>(feature);
+}
+
+// what a program draws; the forward passes are in RenderMode order
+enum class ShaderPass {
+    Position,
+    Normal,
+    TexCoords,
+    Diffuse,
+    Specular,
+    GBuffer,
+    GBufferView,
+    Upscale,
+    Count
+};
+
+// programs built from one source per stage: a pass selects the files and a PASS_* define, the
+// features add theirs; features a pass does not read are dropped, so that e.g. the normal pass
+// has no texture variants
+//
+// variants are built on first use without blocking the frame; get() returns nullptr until the
+// driver is done, update() finishes them and rebuilds every variant whose source file changed
+class ShaderLibrary {
+public:
+    // called for every program that becomes usable, e.g. to bind its uniform blocks
+    using SetupFunction = std::function<void(ShaderPass, const Shader&)>;
+
+    ShaderLibrary() { }
+
+    ShaderLibrary(const ShaderLibrary &) = delete;
+    ShaderLibrary &operator=(const ShaderLibrary &) = delete;
+
+    void set_setup(SetupFunction setup) {
+        this->setup = std::move(setup);
+    }
+
+    // the built variant, or nullptr while it is being built or when it failed to build
+    const Shader *get(ShaderPass pass, ShaderFeatures features) {
+        features &= passes[static_cast<std::size_t>(pass)].features;
+        const std::uint32_t key = make_key(pass, features);
+        auto it = variants.find(key);
+        if (it == variants.end()) {
+            it = variants.emplace(key, Variant()).first;
+            Variant &variant = it->second;
+            variant.pass = pass;
+            variant.features = features;
+            start_build(variant);
+            // a program binary from the cache is usable right away
+            if (variant.building->is_build_complete()) {
+                complete_build(variant);
+            }
+        }
+        return it->second.shader.get();
+    }
+
+    // GL thread, once per frame; true when a program was replaced or became usable
+    bool update() {
+        bool changed = false;
+        for (auto &item : variants) {
+            Variant &variant = item.second;
+            if (variant.building && variant.building->is_build_complete()) {
+                changed |= complete_build(variant);
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last_reload_check >= reload_interval) {
+            last_reload_check = now;
+            reload_changed_sources();
+        }
+        return changed;
+    }
+
+    // variants still being built
+    std::size_t get_pending_count() const {
+        std::size_t n = 0;
+        for (const auto &item : variants) {
+            n += item.second.building ? 1 : 0;
+        }
+        return n;
+    }
+
+    std::size_t get_variant_count() const {
+        return variants.size();
+    }
+
+    std::size_t get_reload_count() const {
+        return n_reloads;
+    }
+
+    void destroy() {
+        for (auto &item : variants) {
+            Variant &variant = item.second;
+            if (variant.shader) {
+                variant.shader->destroy();
+            }
+            if (variant.building) {
+                variant.building->destroy();
+            }
+        }
+        variants.clear();
+        source_times.clear();
+    }
+
+private:
+    struct PassSources {
+        const char *vertex_filepath;
+        const char *fragment_filepath;
+        const char *define;
+        // the features the pass reads
+        ShaderFeatures features;
+    };
+
+    static constexpr ShaderFeatures texture_features =
+        feature_bit(ShaderFeature::DiffuseTexture) | feature_bit(ShaderFeature::SpecularTexture);
+    static constexpr ShaderFeatures vertex_features = feature_bit(ShaderFeature::CompactVertices);
+
+    static constexpr PassSources passes[] = {
+        {"shaders/shader.vert", "shaders/material.frag", "PASS_POSITION", vertex_features},
+        {"shaders/shader.vert", "shaders/material.frag", "PASS_NORMAL", vertex_features},
+        {"shaders/shader.vert", "shaders/material.frag", "PASS_TEXCOORDS", vertex_features},
+        {"shaders/shader.vert", "shaders/material.frag", "PASS_DIFFUSE", vertex_features | feature_bit(ShaderFeature::DiffuseTexture)},
+        {"shaders/shader.vert", "shaders/material.frag", "PASS_SPECULAR", vertex_features | feature_bit(ShaderFeature::SpecularTexture)},
+        {"shaders/shader.vert", "shaders/material.frag", "PASS_GBUFFER", vertex_features | texture_features},
+        {"shaders/fullscreen.vert", "shaders/gbuffer_view.frag", nullptr, 0},
+        {"shaders/fullscreen.vert", "shaders/upscale.frag", nullptr, 0},
+    };
+
+    static_assert(sizeof(passes) / sizeof(passes[0]) == static_cast<std::size_t>(ShaderPass::Count),
+        "every ShaderPass needs its sources");
+
+    // usable program and, while building, its replacement
+    struct Variant {
+        ShaderPass pass = ShaderPass::Position;
+        ShaderFeatures features = 0;
+        std::unique_ptr<Shader> shader;
+        std::unique_ptr<Shader> building;
+        std::chrono::steady_clock::time_point build_start;
+    };
+
+    static constexpr std::chrono::milliseconds reload_interval{500};
+
+    SetupFunction setup;
+    std::unordered_map<std::uint32_t, Variant> variants;
+    // last write times of the sources in use
+    std::unordered_map<std::string, std::filesystem::file_time_type> source_times;
+    std::chrono::steady_clock::time_point last_reload_check = std::chrono::steady_clock::now();
+    std::size_t n_reloads = 0;
+
+    static std::uint32_t make_key(ShaderPass pass, ShaderFeatures features) {
+        return (static_cast<std::uint32_t>(pass) << 24) | features;
+    }
+
+    void start_build(Variant &variant) {
+        const PassSources &sources = passes[static_cast<std::size_t>(variant.pass)];
+        std::vector<std::string> defines;
+        if (sources.define) {
+            defines.push_back(sources.define);
+        }
+        for (std::size_t i = 0; i < static_cast<std::size_t>(ShaderFeature::Count); ++i) {
+            if (variant.features & (ShaderFeatures(1) << i)) {
+                defines.push_back(shader_feature_names[i]);
+            }
+        }
+        for (const char *filepath : {sources.vertex_filepath, sources.fragment_filepath}) {
+            if (source_times.find(filepath) == source_times.end()) {
+                std::error_code ec;
+                source_times[filepath] = std::filesystem::last_write_time(filepath, ec);
+            }
+        }
+        if (variant.building) {
+            variant.building->destroy();
+        }
+        variant.build_start = std::chrono::steady_clock::now();
+        variant.building = std::make_unique<Shader>(sources.vertex_filepath, sources.fragment_filepath, defines);
+    }
+
+    // a failed rebuild keeps the previous program
+    bool complete_build(Variant &variant) {
+        std::unique_ptr<Shader> shader = std::move(variant.building);
+        if (!shader->finish()) {
+            shader->destroy();
+            return false;
+        }
+        if (setup) {
+            setup(variant.pass, *shader);
+        }
+        if (variant.shader) {
+            variant.shader->destroy();
+        }
+        variant.shader = std::move(shader);
+
+        const std::chrono::duration<double, std::milli> build_time = std::chrono::steady_clock::now() - variant.build_start;
+        std::cout << "[ShaderLibrary] " << describe(variant) << " ready in " << build_time.count() << " ms"
+            << (variant.shader->is_from_cache() ? " (program cache)" : "") << std::endl;
+        return true;
+    }
+
+    void reload_changed_sources() {
+        for (auto &item : source_times) {
+            std::error_code ec;
+            const auto time = std::filesystem::last_write_time(item.first, ec);
+            if (ec || time == item.second) {
+                continue;
+            }
+            item.second = time;
+            std::cout << "[ShaderLibrary] " << item.first << " changed, rebuilding" << std::endl;
+            n_reloads++;
+            for (auto &variant_item : variants) {
+                Variant &variant = variant_item.second;
+                const PassSources &sources = passes[static_cast<std::size_t>(variant.pass)];
+                if (item.first == sources.vertex_filepath || item.first == sources.fragment_filepath) {
+                    start_build(variant);
+                }
+            }
+        }
+    }
+
+    static std::string describe(const Variant &variant) {
+        const PassSources &sources = passes[static_cast<std::size_t>(variant.pass)];
+        std::string str = sources.define ? sources.define : sources.fragment_filepath;
+        for (std::size_t i = 0; i < static_cast<std::size_t>(ShaderFeature::Count); ++i) {
+            if (variant.features & (ShaderFeatures(1) << i)) {
+                str += std::string(" ") + shader_feature_names[i];
+            }
+        }
+        return str;
+    }
+};
@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <zmv/mesh.h>
+
+// quadric error metric simplification by edge collapse, used to build LOD index buffers
+//
+// vertices are only ever collapsed onto existing vertices, so every LOD shares the vertex buffer
+// of the mesh; vertices on open boundaries and on attribute seams (several vertices sharing a
+// position, e.g. UV or normal seams) are locked so the silhouette and texturing stay intact
+class Simplifier {
+public:
+    // LOD levels including the full resolution one
+    static constexpr std::size_t max_lod_levels = 4;
+    // meshes smaller than this are cheap enough to always draw in full
+    static constexpr std::size_t min_lod_triangles = 256;
+
+    // appends up to max_lod_levels - 1 simplified index buffers to mesh.indices and describes them in mesh.lods
+    static void generate_lods(MeshData &mesh) {
+        const std::size_t n_indices = mesh.indices.size();
+        mesh.lods.clear();
+        mesh.lods.push_back({0, static_cast<unsigned int>(n_indices), 0.0f});
+        if (n_indices / 3 < min_lod_triangles) {
+            return ;
+        }
+
+        // every level halves the triangle count of the previous one and starts from it
+        std::vector<unsigned int> previous = mesh.indices;
+        float error = 0.0f;
+        for (std::size_t level = 1; level < max_lod_levels; ++level) {
+            const std::size_t target_index_count = (n_indices >> level) / 3 * 3;
+            float level_error = 0.0f;
+            std::vector<unsigned int> simplified = simplify(
+                mesh.vertices.data(), mesh.vertices.size(), previous, target_index_count, level_error
+            );
+            // stuck on locked vertices, a level that barely differs is not worth its memory
+            if (simplified.empty() || simplified.size() > previous.size() * 9 / 10) {
+                break;
+            }
+
+            // errors of consecutive levels add up relative to the full resolution mesh
+            error += level_error;
+            mesh.lods.push_back({
+                static_cast<unsigned int>(mesh.indices.size()),
+                static_cast<unsigned int>(simplified.size()),
+                error
+            });
+            mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+            previous = std::move(simplified);
+        }
+    }
+
+    // returns at most target_index_count indices unless locked vertices prevent it,
+    // error receives the largest collapse distance in model space units
+    static std::vector<unsigned int> simplify(
+        const Vertex *vertices,
+        std::size_t n_vertices,
+        std::vector<unsigned int> indices,
+        std::size_t target_index_count,
+        float &error
+    ) {
+        error = 0.0f;
+        const std::vector<bool> locked = find_locked_vertices(vertices, n_vertices, indices);
+
+        std::vector<Quadric> quadrics(n_vertices);
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const Quadric quadric = Quadric::from_triangle(
+                vertices[indices[i]].position, vertices[indices[i + 1]].position, vertices[indices[i + 2]].position
+            );
+            for (std::size_t k = 0; k < 3; ++k) {
+                quadrics[indices[i + k]] += quadric;
+            }
+        }
+
+        std::vector<unsigned int> remap(n_vertices);
+        std::vector<bool> touched(n_vertices);
+        std::vector<Collapse> collapses;
+        std::vector<unsigned int> adjacency_offsets;
+        std::vector<unsigned int> adjacency;
+        float max_cost = 0.0f;
+
+        while (indices.size() > target_index_count) {
+            // one candidate per directed triangle edge, the neighbouring triangle provides the other direction
+            collapses.clear();
+            for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+                for (std::size_t k = 0; k < 3; ++k) {
+                    const unsigned int from = indices[i + k];
+                    const unsigned int to = indices[i + (k + 1) % 3];
+                    if (locked[from]) {
+                        continue;
+                    }
+                    Quadric quadric = quadrics[from];
+                    quadric += quadrics[to];
+                    collapses.push_back({from, to, quadric.distance_squared(vertices[to].position)});
+                }
+            }
+            if (collapses.empty()) {
+                break;
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+                return a.cost < b.cost;
+            });
+
+            build_adjacency(indices, n_vertices, adjacency_offsets, adjacency);
+            for (std::size_t i = 0; i < n_vertices; ++i) {
+                remap[i] = static_cast<unsigned int>(i);
+            }
+            std::fill(touched.begin(), touched.end(), false);
+
+            // greedily apply the cheapest collapses whose neighbourhoods do not overlap
+            std::size_t n_triangles = indices.size() / 3;
+            const std::size_t target_triangles = target_index_count / 3;
+            std::size_t n_collapsed = 0;
+            for (const auto &collapse : collapses) {
+                if (n_triangles <= target_triangles) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+
+                std::size_t n_removed = 0;
+                if (!collapse_keeps_orientation(vertices, indices, adjacency_offsets, adjacency, collapse, n_removed)) {
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                for (unsigned int j = adjacency_offsets[collapse.from]; j < adjacency_offsets[collapse.from + 1]; ++j) {
+                    const std::size_t triangle = adjacency[j];
+                    for (std::size_t k = 0; k < 3; ++k) {
+                        touched[indices[triangle * 3 + k]] = true;
+                    }
+                }
+                n_triangles -= n_removed;
+                max_cost = std::max(max_cost, collapse.cost);
+                n_collapsed++;
+            }
+            if (n_collapsed == 0) {
+                break;
+            }
+
+            // apply the remap and drop triangles that became degenerate
+            std::size_t n_kept = 0;
+            for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+                const unsigned int a = remap[indices[i]];
+                const unsigned int b = remap[indices[i + 1]];
+                const unsigned int c = remap[indices[i + 2]];
+                if (a == b || b == c || c == a) {
+                    continue;
+                }
+                indices[n_kept++] = a;
+                indices[n_kept++] = b;
+                indices[n_kept++] = c;
+            }
+            indices.resize(n_kept);
+        }
+
+        error = std::sqrt(max_cost);
+        return indices;
+    }
+
+private:
+    // plane quadric accumulated with area weights, distance_squared is normalized by the total weight
+    struct Quadric {
+        double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+        double b2 = 0.0, bc = 0.0, bd = 0.0;
+        double c2 = 0.0, cd = 0.0;
+        double d2 = 0.0;
+        double weight = 0.0;
+
+        static Quadric from_triangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2) {
+            Quadric quadric;
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float length = glm::length(normal);
+            if (length == 0.0f) {
+                return quadric;
+            }
+            const double a = normal.x / length;
+            const double b = normal.y / length;
+            const double c = normal.z / length;
+            const double d = -(a * p0.x + b * p0.y + c * p0.z);
+            const double area = 0.5 * length;
+
+            quadric.a2 = area * a * a;
+            quadric.ab = area * a * b;
+            quadric.ac = area * a * c;
+            quadric.ad = area * a * d;
+            quadric.b2 = area * b * b;
+            quadric.bc = area * b * c;
+            quadric.bd = area * b * d;
+            quadric.c2 = area * c * c;
+            quadric.cd = area * c * d;
+            quadric.d2 = area * d * d;
+            quadric.weight = area;
+            return quadric;
+        }
+
+        Quadric &operator+=(const Quadric &other) {
+            a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+            b2 += other.b2; bc += other.bc; bd += other.bd;
+            c2 += other.c2; cd += other.cd;
+            d2 += other.d2;
+            weight += other.weight;
+            return *this;
+        }
+
+        float distance_squared(const glm::vec3 &p) const {
+            const double x = p.x, y = p.y, z = p.z;
+            const double error =
+                a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x +
+                b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y +
+                c2 * z * z + 2.0 * cd * z +
+                d2;
+            return weight > 0.0 ? static_cast<float>(std::max(error, 0.0) / weight) : 0.0f;
+        }
+    };
+
+    struct Collapse {
+        unsigned int from;
+        unsigned int to;
+        float cost;
+    };
+
+    struct PositionHash {
+        std::size_t operator()(const glm::vec3 &p) const {
+            std::uint32_t bits[3];
+            std::memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    struct PositionEqual {
+        bool operator()(const glm::vec3 &a, const glm::vec3 &b) const {
+            return a.x == b.x && a.y == b.y && a.z == b.z;
+        }
+    };
+
+    static std::vector<bool> find_locked_vertices(const Vertex *vertices, std::size_t n_vertices, const std::vector<unsigned int> &indices) {
+        // vertices with equal positions form one position, more than one vertex per position is a seam
+        std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> positions;
+        std::vector<unsigned int> position_of(n_vertices);
+        std::vector<unsigned int> n_vertices_per_position;
+        for (std::size_t i = 0; i < n_vertices; ++i) {
+            const auto it = positions.emplace(vertices[i].position, static_cast<unsigned int>(n_vertices_per_position.size()));
+            if (it.second) {
+                n_vertices_per_position.push_back(0);
+            }
+            position_of[i] = it.first->second;
+            n_vertices_per_position[it.first->second]++;
+        }
+
+        // an edge without a twin in the opposite direction lies on an open boundary
+        std::unordered_map<std::uint64_t, unsigned int> edges;
+        auto edge_key = [](unsigned int a, unsigned int b) {
+            return static_cast<std::uint64_t>(a) << 32 | b;
+        };
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                edges[edge_key(position_of[indices[i + k]], position_of[indices[i + (k + 1) % 3]])]++;
+            }
+        }
+        std::vector<bool> boundary_position(n_vertices_per_position.size());
+        for (const auto &edge : edges) {
+            const unsigned int a = static_cast<unsigned int>(edge.first >> 32);
+            const unsigned int b = static_cast<unsigned int>(edge.first & 0xffffffffu);
+            if (edges.find(edge_key(b, a)) == edges.end()) {
+                boundary_position[a] = true;
+                boundary_position[b] = true;
+            }
+        }
+
+        std::vector<bool> locked(n_vertices);
+        for (std::size_t i = 0; i < n_vertices; ++i) {
+            const unsigned int position = position_of[i];
+            locked[i] = n_vertices_per_position[position] > 1 || boundary_position[position];
+        }
+        return locked;
+    }
+
+    // triangles around every vertex in compressed rows
+    static void build_adjacency(
+        const std::vector<unsigned int> &indices,
+        std::size_t n_vertices,
+        std::vector<unsigned int> &offsets,
+        std::vector<unsigned int> &adjacency
+    ) {
+        offsets.assign(n_vertices + 1, 0);
+        for (const auto index : indices) {
+            offsets[index + 1]++;
+        }
+        for (std::size_t i = 0; i < n_vertices; ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+        adjacency.resize(indices.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    }
+
+    // rejects collapses that would flip a triangle around `from`, counts the triangles it removes
+    static bool collapse_keeps_orientation(
+        const Vertex *vertices,
+        const std::vector<unsigned int> &indices,
+        const std::vector<unsigned int> &adjacency_offsets,
+        const std::vector<unsigned int> &adjacency,
+        const Collapse &collapse,
+        std::size_t &n_removed
+    ) {
+        const glm::vec3 &target = vertices[collapse.to].position;
+        for (unsigned int j = adjacency_offsets[collapse.from]; j < adjacency_offsets[collapse.from + 1]; ++j) {
+            const unsigned int *triangle = &indices[adjacency[j] * 3];
+            if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                n_removed++;
+                continue;
+            }
+
+            glm::vec3 p[3];
+            for (std::size_t k = 0; k < 3; ++k) {
+                p[k] = vertices[triangle[k]].position;
+            }
+            const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for (std::size_t k = 0; k < 3; ++k) {
+                if (triangle[k] == collapse.from) {
+                    p[k] = target;
+                }
+            }
+            const glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, after) <= 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
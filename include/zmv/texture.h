@@ -1,16 +1,108 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <glad/glad.h>
 #include <stb_image.h>
 
+#include <zmv/texture_compressor.h>
+
 enum class TextureType {
     DIFFUSE, SPECULAR
 };
 
+// decoded image waiting for upload, decode() does not touch GL and may run on any thread
+struct TextureData {
+    struct ImageDeleter {
+        // false for buffers made by reduce()
+        bool from_stb;
+
+        ImageDeleter() : from_stb(true) { }
+
+        explicit ImageDeleter(bool from_stb) : from_stb(from_stb) { }
+
+        void operator()(unsigned char *image) const {
+            if (from_stb) {
+                stbi_image_free(image);
+            } else {
+                delete[] image;
+            }
+        }
+    };
+
+    std::string filepath;
+    TextureType texture_type;
+    // size of mip level 0, also when only coarser levels are held
+    int width = 0;
+    int height = 0;
+    std::unique_ptr<unsigned char, ImageDeleter> pixels; // RGB8, mip level base_level
+    CompressedImage compressed; // replaces pixels when TextureCache compresses textures
+    int base_level = 0;
+    std::uint64_t key = 0; // TextureCache key, 0 until prepared
+    std::uint64_t content_hash = 0;
+
+    static int level_count(int width, int height) {
+        int n_levels = 1;
+        while ((width >> n_levels) > 0 || (height >> n_levels) > 0) {
+            n_levels++;
+        }
+        return n_levels;
+    }
+
+    static int level_width(int width, int level) {
+        return std::max(1, width >> level);
+    }
+
+    // replaces the pixels by mip level `level`, box filtered like the compressed mip chains
+    void reduce(int level) {
+        if (level <= base_level || !pixels) {
+            return ;
+        }
+        std::vector<unsigned char> current;
+        std::vector<unsigned char> next;
+        const unsigned char *source = pixels.get();
+        for (int l = base_level; l < level; ++l) {
+            TextureCompressor::downsample(level_width(width, l), level_width(height, l), source,
+                                          level_width(width, l + 1), level_width(height, l + 1), next);
+            current.swap(next);
+            source = current.data();
+        }
+        unsigned char *reduced = new unsigned char[current.size()];
+        std::copy(current.begin(), current.end(), reduced);
+        pixels = std::unique_ptr<unsigned char, ImageDeleter>(reduced, ImageDeleter{false});
+        base_level = level;
+    }
+
+    bool decode() {
+        int channels;
+        base_level = 0;
+        pixels.reset(stbi_load(filepath.c_str(), &width, &height, &channels, 3));
+        if (!pixels) {
+            std::cerr << "failed to open " << filepath << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // decode from the file contents that were already read into memory
+    bool decode(const std::vector<unsigned char> &bytes) {
+        int channels;
+        base_level = 0;
+        pixels.reset(stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels, 3));
+        if (!pixels) {
+            std::cerr << "failed to decode " << filepath << ": " << stbi_failure_reason() << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
 class Texture {
 public:
     std::string filepath;
@@ -33,6 +125,16 @@ public:
         load_image(filepath);
     }
 
+    Texture(const TextureData &data) : Texture() {
+        this->filepath = data.filepath;
+        this->texture_type = data.texture_type;
+        if (!data.compressed.empty()) {
+            upload(data.compressed);
+        } else if (data.pixels) {
+            upload(data.width, data.height, data.pixels.get(), data.base_level);
+        }
+    }
+
     void destroy() {
         glDeleteTextures(1, &id);
     }
@@ -46,11 +148,36 @@ public:
             return ;
         }
 
+        upload(width, height, image);
+        stbi_image_free(image);
+    }
+
+private:
+    // image is mip level base_level of a width x height texture, the finer levels are left
+    // undefined for TextureStreamer and excluded through GL_TEXTURE_BASE_LEVEL
+    void upload(int width, int height, const unsigned char *image, int base_level = 0) const {
+        // rows of RGB8 images are not 4 byte aligned in general
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
         // set image to texture 
         glBindTexture(GL_TEXTURE_2D, id);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+        glTexImage2D(GL_TEXTURE_2D, base_level, GL_RGB, TextureData::level_width(width, base_level), TextureData::level_width(height, base_level),
+                     0, GL_RGB, GL_UNSIGNED_BYTE, image);
         glGenerateMipmap(GL_TEXTURE_2D);
         glBindTexture(GL_TEXTURE_2D, 0);
-        stbi_image_free(image);
+    }
+
+    // every level comes precomputed, glGenerateMipmap does not work on compressed formats
+    void upload(const CompressedImage &image) const {
+        glBindTexture(GL_TEXTURE_2D, id);
+        for (std::size_t i = 0; i < image.levels.size(); ++i) {
+            const CompressedImage::Level &l = image.levels[i];
+            glCompressedTexImage2D(GL_TEXTURE_2D, image.first_level + static_cast<GLint>(i), image.format, l.width, l.height, 0,
+                                   static_cast<GLsizei>(l.size), image.data.data() + l.offset);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, image.first_level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.first_level + static_cast<GLint>(image.levels.size()) - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
 };
\ No newline at end of file
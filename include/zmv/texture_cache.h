@@ -0,0 +1,289 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <zmv/hash.h>
+#include <zmv/texture.h>
+#include <zmv/texture_compressor.h>
+#include <zmv/texture_streamer.h>
+
+// process-wide cache of GPU textures that outlives individual models
+//
+// entries are keyed by canonical path + content hash and shared between models through
+// reference counting; textures nobody references stay resident until the memory budget
+// forces them out in least recently used order
+//
+// with compression enabled images are encoded to BC1 once and the result is kept on disk
+// next to the mesh cache, later loads skip both decoding and encoding
+//
+// with streaming enabled textures are created with their coarse mip levels only and the
+// TextureStreamer adds finer ones as the models request them
+class TextureCache {
+public:
+    static TextureCache &instance() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    TextureCache(const TextureCache &) = delete;
+    TextureCache &operator=(const TextureCache &) = delete;
+
+    // CPU side preparation, safe to call from worker threads:
+    // computes the key and decodes (and compresses) the image unless it is already resident
+    void prepare(TextureData &texture) const {
+        std::vector<unsigned char> bytes;
+        if (!read_file(texture.filepath, bytes)) {
+            std::cerr << "failed to open " << texture.filepath << std::endl;
+            return ;
+        }
+        const bool compress = compression;
+        const bool stream = streaming;
+        const std::uint64_t content_hash = Hash().add(bytes.data(), bytes.size()).digest();
+        texture.key = make_key(texture.filepath, content_hash, compress);
+        texture.content_hash = content_hash;
+        if (is_resident(texture.key)) {
+            return ;
+        }
+        if (!compress) {
+            if (texture.decode(bytes) && stream) {
+                texture.reduce(TextureStreamer::initial_level(texture.width, texture.height));
+            }
+            return ;
+        }
+
+        // a cache hit reads the coarse levels only when streaming
+        if (!compressor.load(content_hash, texture.compressed, stream ? TextureStreamer::initial_size : 1 << 30)) {
+            if (!texture.decode(bytes)) {
+                return ;
+            }
+            texture.compressed = TextureCompressor::compress(texture.width, texture.height, texture.pixels.get());
+            texture.pixels.reset();
+            compressor.store(content_hash, texture.compressed);
+            if (stream) {
+                texture.compressed.drop_finest(TextureStreamer::initial_level(texture.width, texture.height));
+            }
+        }
+        texture.width = texture.compressed.width;
+        texture.height = texture.compressed.height;
+        texture.base_level = texture.compressed.first_level;
+    }
+
+    // GL thread only, returns the resident texture and uploads it first if needed
+    std::shared_ptr<Texture> acquire(TextureData &texture) {
+        if (texture.key == 0) {
+            prepare(texture);
+        }
+        if (texture.key == 0) {
+            // unreadable file, cached under its path so that it is still released with the cache
+            texture.key = make_key(texture.filepath, 0, false);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(texture.key);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it->second.lru_position);
+            n_hits++;
+            return it->second.texture;
+        }
+
+        // evicted between prepare() and now, decode on this thread; not worth blocking the
+        // frame for compression, the texture is uploaded uncompressed and in full until it is loaded again
+        if (!texture.pixels && texture.compressed.empty()) {
+            texture.decode();
+        }
+
+        n_misses++;
+        Entry entry;
+        entry.texture = std::make_shared<Texture>(texture);
+        const GLenum format = texture.compressed.format;
+        if (!texture.pixels && texture.compressed.empty()) {
+            entry.n_bytes = 0;
+        } else {
+            entry.n_bytes = TextureStreamer::resident_size(format, texture.width, texture.height, texture.base_level);
+        }
+        if (entry.n_bytes > 0 && texture.base_level > 0) {
+            streamer.add(texture.key, entry.texture->id, {texture.filepath, texture.content_hash, format, texture.width, texture.height}, texture.base_level);
+        }
+        lru.push_front(texture.key);
+        entry.lru_position = lru.begin();
+        n_resident_bytes += entry.n_bytes;
+        std::shared_ptr<Texture> result = entry.texture;
+        entries.emplace(texture.key, std::move(entry));
+
+        evict();
+        return result;
+    }
+
+    // the finest mip level each texture needs, from the screen size of the meshes using it
+    void request(const std::vector<std::uint64_t> &keys, const std::vector<float> &pixels) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            if (pixels[i] > 0.0f) {
+                streamer.request(keys[i], pixels[i]);
+            }
+        }
+    }
+
+    // GL thread, once per frame: streams requested mip levels in and unneeded ones out
+    void update_streaming() {
+        std::lock_guard<std::mutex> lock(mutex);
+        streamer.update(n_resident_bytes, budget_bytes, [this](std::uint64_t key, std::size_t n_added, std::size_t n_removed) {
+            Entry &entry = entries.at(key);
+            entry.n_bytes = entry.n_bytes + n_added - n_removed;
+            n_resident_bytes = n_resident_bytes + n_added - n_removed;
+        });
+    }
+
+    // drop unreferenced textures until the cache fits into its budget
+    void trim() {
+        std::lock_guard<std::mutex> lock(mutex);
+        evict();
+    }
+
+    // destroys every texture, models must have released theirs already
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &entry : entries) {
+            entry.second.texture->destroy();
+        }
+        streamer.clear();
+        entries.clear();
+        lru.clear();
+        n_resident_bytes = 0;
+    }
+
+    std::size_t get_budget() const {
+        return budget_bytes;
+    }
+
+    void set_budget(std::size_t budget_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->budget_bytes = budget_bytes;
+        evict();
+    }
+
+    // GL thread only, called once the context exists
+    void set_compression_supported(bool supported) {
+        compression_supported = supported;
+        compression = supported;
+    }
+
+    bool is_compression_supported() const {
+        return compression_supported;
+    }
+
+    bool get_compression() const {
+        return compression;
+    }
+
+    // applies to textures prepared afterwards, resident ones keep their format
+    void set_compression(bool compression) {
+        this->compression = compression && compression_supported;
+    }
+
+    bool get_streaming() const {
+        return streaming;
+    }
+
+    // applies to textures prepared afterwards, resident ones keep their mip levels
+    void set_streaming(bool streaming) {
+        this->streaming = streaming;
+    }
+
+    const TextureStreamer &get_streamer() const {
+        return streamer;
+    }
+
+    std::size_t get_resident_bytes() const {
+        return n_resident_bytes;
+    }
+
+    std::size_t get_resident_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    std::size_t get_hit_count() const {
+        return n_hits;
+    }
+
+    std::size_t get_miss_count() const {
+        return n_misses;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<Texture> texture;
+        std::size_t n_bytes;
+        std::list<std::uint64_t>::iterator lru_position;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::uint64_t, Entry> entries;
+    // most recently used first
+    std::list<std::uint64_t> lru;
+    std::size_t budget_bytes = 512u << 20;
+    std::size_t n_resident_bytes = 0;
+    std::size_t n_hits = 0;
+    std::size_t n_misses = 0;
+    std::atomic<bool> compression_supported{false};
+    std::atomic<bool> compression{false};
+    std::atomic<bool> streaming{true};
+    TextureCompressor compressor;
+    TextureStreamer streamer;
+
+    TextureCache() { }
+
+    bool is_resident(std::uint64_t key) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.count(key) > 0;
+    }
+
+    // textures that are still referenced by a model are never evicted
+    void evict() {
+        auto it = lru.end();
+        while (n_resident_bytes > budget_bytes && it != lru.begin()) {
+            --it;
+            auto entry = entries.find(*it);
+            if (entry->second.texture.use_count() > 1) {
+                continue;
+            }
+            streamer.remove(*it);
+            entry->second.texture->destroy();
+            n_resident_bytes -= entry->second.n_bytes;
+            entries.erase(entry);
+            it = lru.erase(it);
+        }
+    }
+
+    static bool read_file(const std::string &filepath, std::vector<unsigned char> &bytes) {
+        std::ifstream file(filepath, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // compressed and uncompressed uploads of the same image are separate entries
+    static std::uint64_t make_key(const std::string &filepath, std::uint64_t content_hash, bool compressed) {
+        std::error_code ec;
+        const std::filesystem::path canonical_path = std::filesystem::canonical(filepath, ec);
+        const std::uint64_t key = Hash()
+            .add(ec ? filepath : canonical_path.generic_string())
+            .add(content_hash)
+            .add(compressed)
+            .digest();
+        // 0 marks "not prepared yet"
+        return key != 0 ? key : 1;
+    }
+};
@@ -0,0 +1,448 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <zmv/hash.h>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// block compressed mip chain, levels[0] is mip level first_level of a width x height image
+struct CompressedImage {
+    struct Level {
+        int width;
+        int height;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    GLenum format = 0;
+    int width = 0;
+    int height = 0;
+    int first_level = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+
+    bool empty() const {
+        return levels.empty();
+    }
+
+    std::size_t size_in_bytes() const {
+        return data.size();
+    }
+
+    // frees the n finest levels, the coarsest one is always kept
+    void drop_finest(std::size_t n) {
+        n = std::min(n, levels.size() - 1);
+        if (n == 0) {
+            return ;
+        }
+        const std::size_t offset = levels[n].offset;
+        data.erase(data.begin(), data.begin() + offset);
+        levels.erase(levels.begin(), levels.begin() + n);
+        for (auto &level : levels) {
+            level.offset -= offset;
+        }
+        first_level += static_cast<int>(n);
+    }
+};
+
+// CPU encoder from RGB8 to BC1 plus the on-disk cache of its results
+//
+// images are always decoded to RGB8, so BC1 (4 bits per pixel, no alpha) covers every texture;
+// the mip chain is box filtered here instead of by glGenerateMipmap, which cannot run on
+// compressed textures
+class TextureCompressor {
+public:
+    TextureCompressor(const std::string &cache_directory = ".zmv_cache/textures") :
+        cache_directory(cache_directory) { }
+
+    // GL thread only, BC1 is part of EXT_texture_compression_s3tc
+    static bool is_supported() {
+        GLint n_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+        for (GLint i = 0; i < n_extensions; ++i) {
+            const char *name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0 ||
+                         std::strcmp(name, "GL_EXT_texture_compression_dxt1") == 0)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // encodes every mip level of an RGB8 image, safe to call from worker threads
+    static CompressedImage compress(int width, int height, const unsigned char *rgb) {
+        CompressedImage image;
+        image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        image.width = width;
+        image.height = height;
+
+        std::size_t n_bytes = 0;
+        for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+            const std::size_t size = static_cast<std::size_t>((w + 3) / 4) * ((h + 3) / 4) * block_size;
+            image.levels.push_back({w, h, n_bytes, size});
+            n_bytes += size;
+            if (w == 1 && h == 1) {
+                break;
+            }
+        }
+        image.data.resize(n_bytes);
+
+        std::vector<unsigned char> level_pixels;
+        std::vector<unsigned char> next_pixels;
+        const unsigned char *pixels = rgb;
+        for (std::size_t i = 0; i < image.levels.size(); ++i) {
+            const CompressedImage::Level &level = image.levels[i];
+            if (i > 0) {
+                const CompressedImage::Level &previous = image.levels[i - 1];
+                downsample(previous.width, previous.height, pixels, level.width, level.height, next_pixels);
+                level_pixels.swap(next_pixels);
+                pixels = level_pixels.data();
+            }
+            encode_level(level.width, level.height, pixels, image.data.data() + level.offset);
+        }
+        return image;
+    }
+
+    // content_hash identifies the source file, stale entries can therefore not be hit;
+    // levels larger than max_size and finer than min_level are skipped without being read
+    bool load(std::uint64_t content_hash, CompressedImage &image, int max_size = 1 << 30, int min_level = 0) const {
+        std::ifstream file(cache_filepath(content_hash), std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        Header header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(Header)) ||
+            std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+            header.version != version ||
+            header.content_hash != content_hash ||
+            header.n_levels == 0) {
+            return false;
+        }
+
+        CompressedImage result;
+        result.format = header.format;
+        result.levels.resize(header.n_levels);
+        const std::size_t table_size = header.n_levels * sizeof(CompressedImage::Level);
+        if (!file.read(reinterpret_cast<char*>(result.levels.data()), table_size)) {
+            return false;
+        }
+        const CompressedImage::Level &last = result.levels.back();
+        if (last.offset + last.size != header.data_size) {
+            return false;
+        }
+        result.width = result.levels[0].width;
+        result.height = result.levels[0].height;
+
+        std::size_t first = std::min(static_cast<std::size_t>(std::max(min_level, 0)), result.levels.size() - 1);
+        while (first + 1 < result.levels.size() && std::max(result.levels[first].width, result.levels[first].height) > max_size) {
+            first++;
+        }
+        const std::size_t offset = result.levels[first].offset;
+        result.levels.erase(result.levels.begin(), result.levels.begin() + first);
+        for (auto &level : result.levels) {
+            level.offset -= offset;
+        }
+        result.first_level = static_cast<int>(first);
+
+        result.data.resize(header.data_size - offset);
+        file.seekg(static_cast<std::streamoff>(sizeof(Header) + table_size + offset));
+        if (!file.read(reinterpret_cast<char*>(result.data.data()), result.data.size())) {
+            return false;
+        }
+        image = std::move(result);
+        return true;
+    }
+
+    // only complete mip chains are stored
+    void store(std::uint64_t content_hash, const CompressedImage &image) const {
+        if (image.empty() || image.first_level != 0) {
+            return ;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(cache_directory, ec);
+
+        Header header;
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.format = image.format;
+        header.n_levels = static_cast<std::uint32_t>(image.levels.size());
+        header.content_hash = content_hash;
+        header.data_size = image.data.size();
+
+        // same temporary file + rename scheme as MeshCache
+        const std::string final_path = cache_filepath(content_hash);
+        const std::string temporary_path = final_path + ".tmp";
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "[TextureCompressor] failed to open " << temporary_path << std::endl;
+            return ;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(image.levels.data()), image.levels.size() * sizeof(CompressedImage::Level));
+        file.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+        file.close();
+
+        if (!file) {
+            std::cerr << "[TextureCompressor] failed to write " << temporary_path << std::endl;
+            std::filesystem::remove(temporary_path, ec);
+            return ;
+        }
+        std::filesystem::rename(temporary_path, final_path, ec);
+        if (ec) {
+            std::cerr << "[TextureCompressor] failed to write " << final_path << ": " << ec.message() << std::endl;
+            std::filesystem::remove(temporary_path, ec);
+        }
+    }
+
+    // 2x2 box filter, the last row / column is repeated for odd sizes
+    static void downsample(int width, int height, const unsigned char *src, int dst_width, int dst_height, std::vector<unsigned char> &dst) {
+        dst.resize(static_cast<std::size_t>(dst_width) * dst_height * 3);
+        for (int y = 0; y < dst_height; ++y) {
+            const int y0 = std::min(2 * y, height - 1);
+            const int y1 = std::min(2 * y + 1, height - 1);
+            for (int x = 0; x < dst_width; ++x) {
+                const int x0 = std::min(2 * x, width - 1);
+                const int x1 = std::min(2 * x + 1, width - 1);
+                for (int c = 0; c < 3; ++c) {
+                    const int sum =
+                        src[(static_cast<std::size_t>(y0) * width + x0) * 3 + c] +
+                        src[(static_cast<std::size_t>(y0) * width + x1) * 3 + c] +
+                        src[(static_cast<std::size_t>(y1) * width + x0) * 3 + c] +
+                        src[(static_cast<std::size_t>(y1) * width + x1) * 3 + c];
+                    dst[(static_cast<std::size_t>(y) * dst_width + x) * 3 + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr char magic[4] = {'Z', 'M', 'V', 'T'};
+    static constexpr std::uint32_t version = 1;
+    static constexpr std::size_t block_size = 8;
+
+    struct Header {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t format;
+        std::uint32_t n_levels;
+        std::uint64_t content_hash;
+        std::uint64_t data_size;
+    };
+
+    std::string cache_directory;
+
+    std::string cache_filepath(std::uint64_t content_hash) const {
+        return (std::filesystem::path(cache_directory) / (Hash().add(content_hash).hex() + ".bc1")).string();
+    }
+
+    static void encode_level(int width, int height, const unsigned char *rgb, unsigned char *out) {
+        float block[16][3];
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+                // blocks on the border repeat the last pixel
+                for (int i = 0; i < 16; ++i) {
+                    const int x = std::min(bx + i % 4, width - 1);
+                    const int y = std::min(by + i / 4, height - 1);
+                    const unsigned char *pixel = rgb + (static_cast<std::size_t>(y) * width + x) * 3;
+                    block[i][0] = pixel[0];
+                    block[i][1] = pixel[1];
+                    block[i][2] = pixel[2];
+                }
+                encode_block(block, out);
+                out += block_size;
+            }
+        }
+    }
+
+    static std::uint16_t pack_565(const float color[3]) {
+        auto quantize = [](float value, int max) {
+            const int q = static_cast<int>(std::lround(std::clamp(value, 0.0f, 255.0f) * max / 255.0f));
+            return static_cast<std::uint16_t>(q);
+        };
+        return static_cast<std::uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    static void unpack_565(std::uint16_t packed, float color[3]) {
+        const int r = (packed >> 11) & 31;
+        const int g = (packed >> 5) & 63;
+        const int b = packed & 31;
+        color[0] = static_cast<float>((r << 3) | (r >> 2));
+        color[1] = static_cast<float>((g << 2) | (g >> 4));
+        color[2] = static_cast<float>((b << 3) | (b >> 2));
+    }
+
+    static float distance2(const float a[3], const float b[3]) {
+        const float dr = a[0] - b[0];
+        const float dg = a[1] - b[1];
+        const float db = a[2] - b[2];
+        return dr * dr + dg * dg + db * db;
+    }
+
+    // picks the nearest of the four palette colors per pixel, returns the total squared error
+    static float select_indices(const float block[16][3], std::uint16_t c0, std::uint16_t c1, std::uint32_t &indices) {
+        float palette[4][3];
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        indices = 0;
+        float error = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float best_distance = distance2(block[i], palette[0]);
+            for (int p = 1; p < 4; ++p) {
+                const float d = distance2(block[i], palette[p]);
+                if (d < best_distance) {
+                    best = p;
+                    best_distance = d;
+                }
+            }
+            indices |= static_cast<std::uint32_t>(best) << (2 * i);
+            error += best_distance;
+        }
+        return error;
+    }
+
+    // c0 > c1 selects the four color mode, equal endpoints fall into the three color mode
+    // where index 0 still decodes to c0
+    static float encode_endpoints(const float block[16][3], const float e0[3], const float e1[3],
+                                  std::uint16_t &c0, std::uint16_t &c1, std::uint32_t &indices) {
+        c0 = pack_565(e0);
+        c1 = pack_565(e1);
+        if (c0 < c1) {
+            std::swap(c0, c1);
+        }
+        if (c0 == c1) {
+            indices = 0;
+            float color[3];
+            unpack_565(c0, color);
+            float error = 0.0f;
+            for (int i = 0; i < 16; ++i) {
+                error += distance2(block[i], color);
+            }
+            return error;
+        }
+        return select_indices(block, c0, c1, indices);
+    }
+
+    static void encode_block(const float block[16][3], unsigned char out[8]) {
+        // endpoints from the extent of the block along its principal axis
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                mean[c] += block[i][c] / 16.0f;
+            }
+        }
+        float covariance[6] = {};
+        for (int i = 0; i < 16; ++i) {
+            const float r = block[i][0] - mean[0];
+            const float g = block[i][1] - mean[1];
+            const float b = block[i][2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            const float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+            if (length < 1e-6f) {
+                break;
+            }
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+        const float axis_length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+        float t_min = 0.0f;
+        float t_max = 0.0f;
+        for (int i = 0; i < 16; ++i) {
+            const float t = ((block[i][0] - mean[0]) * axis[0] +
+                             (block[i][1] - mean[1]) * axis[1] +
+                             (block[i][2] - mean[2]) * axis[2]) / axis_length2;
+            t_min = std::min(t_min, t);
+            t_max = std::max(t_max, t);
+        }
+        // pull the endpoints in a little, the extremes are usually outliers
+        const float inset = (t_max - t_min) / 16.0f;
+        float e0[3];
+        float e1[3];
+        for (int c = 0; c < 3; ++c) {
+            e0[c] = mean[c] + axis[c] * (t_max - inset);
+            e1[c] = mean[c] + axis[c] * (t_min + inset);
+        }
+
+        std::uint16_t c0;
+        std::uint16_t c1;
+        std::uint32_t indices;
+        float error = encode_endpoints(block, e0, e1, c0, c1, indices);
+
+        // one least squares refinement of the endpoints for the chosen indices
+        if (c0 != c1) {
+            static constexpr float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            float ax[3] = {}, bx[3] = {};
+            for (int i = 0; i < 16; ++i) {
+                const float a = weights[(indices >> (2 * i)) & 3];
+                const float b = 1.0f - a;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (int c = 0; c < 3; ++c) {
+                    ax[c] += a * block[i][c];
+                    bx[c] += b * block[i][c];
+                }
+            }
+            const float determinant = aa * bb - ab * ab;
+            if (std::fabs(determinant) > 1e-6f) {
+                float r0[3];
+                float r1[3];
+                for (int c = 0; c < 3; ++c) {
+                    r0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                    r1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+                }
+                std::uint16_t refined_c0;
+                std::uint16_t refined_c1;
+                std::uint32_t refined_indices;
+                const float refined_error = encode_endpoints(block, r0, r1, refined_c0, refined_c1, refined_indices);
+                if (refined_error < error) {
+                    c0 = refined_c0;
+                    c1 = refined_c1;
+                    indices = refined_indices;
+                    error = refined_error;
+                }
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(c0 & 0xff);
+        out[1] = static_cast<unsigned char>(c0 >> 8);
+        out[2] = static_cast<unsigned char>(c1 & 0xff);
+        out[3] = static_cast<unsigned char>(c1 >> 8);
+        out[4] = static_cast<unsigned char>(indices & 0xff);
+        out[5] = static_cast<unsigned char>((indices >> 8) & 0xff);
+        out[6] = static_cast<unsigned char>((indices >> 16) & 0xff);
+        out[7] = static_cast<unsigned char>(indices >> 24);
+    }
+};
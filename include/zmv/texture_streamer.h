@@ -0,0 +1,431 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <zmv/gl_object.h>
+#include <zmv/texture.h>
+#include <zmv/texture_compressor.h>
+#include <zmv/thread_pool.h>
+
+// streams the fine mip levels of textures in once they are large enough on screen to need them
+//
+// textures start with only the levels up to initial_size resident, see TextureCache::prepare;
+// every frame the models report how many pixels each texture covers, missing levels are read
+// from the compressed texture cache (BC1) or decoded and box filtered again (RGB8) on the thread
+// pool and uploaded through a pixel unpack buffer under a per-frame byte budget; when textures
+// exceed the memory budget, levels finer than needed are dropped again, least recently used first
+//
+// not thread safe, TextureCache calls everything with its lock held on the GL thread
+class TextureStreamer {
+public:
+    // largest mip level that is resident from the start
+    static constexpr int initial_size = 128;
+
+    struct Source {
+        std::string filepath;
+        std::uint64_t content_hash = 0;
+        GLenum format = 0; // compressed format, 0 for RGB8
+        // size of mip level 0
+        int width = 0;
+        int height = 0;
+    };
+
+    TextureStreamer() { }
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    static int initial_level(int width, int height) {
+        int level = 0;
+        while (std::max(TextureData::level_width(width, level), TextureData::level_width(height, level)) > initial_size) {
+            level++;
+        }
+        return level;
+    }
+
+    static std::size_t level_size(GLenum format, int width, int height, int level) {
+        const std::size_t w = TextureData::level_width(width, level);
+        const std::size_t h = TextureData::level_width(height, level);
+        if (format != 0) {
+            // 8 byte BC1 blocks of 4x4 pixels
+            return ((w + 3) / 4) * ((h + 3) / 4) * 8;
+        }
+        return w * h * 3;
+    }
+
+    // bytes of mip levels base_level and coarser
+    static std::size_t resident_size(GLenum format, int width, int height, int base_level) {
+        std::size_t n_bytes = 0;
+        for (int level = base_level; level < TextureData::level_count(width, height); ++level) {
+            n_bytes += level_size(format, width, height, level);
+        }
+        return n_bytes;
+    }
+
+    // texture has mip levels base_level and coarser resident
+    void add(std::uint64_t key, GLuint texture, const Source &source, int base_level) {
+        Entry entry;
+        entry.texture = texture;
+        entry.source = source;
+        entry.n_levels = TextureData::level_count(source.width, source.height);
+        entry.base_level = base_level;
+        entry.needed_level = entry.n_levels - 1;
+        entries[key] = std::move(entry);
+    }
+
+    // results of jobs still running for the texture are dropped when they arrive
+    void remove(std::uint64_t key) {
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            release_streamed(it->second);
+            entries.erase(it);
+        }
+    }
+
+    void clear() {
+        for (auto &item : entries) {
+            release_streamed(item.second);
+        }
+        entries.clear();
+        pixel_buffer.reset();
+    }
+
+    // pixels: size of a mesh using the texture on screen, the largest one per frame counts
+    void request(std::uint64_t key, float pixels) {
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            it->second.coverage = std::max(it->second.coverage, pixels);
+        }
+    }
+
+    // GL thread, once per frame after drawing; on_resize(key, n_bytes_added, n_bytes_removed)
+    // is called whenever the resident size of a texture changes
+    template <typename F>
+    void update(std::size_t n_resident_bytes, std::size_t budget_bytes, F &&on_resize) {
+        frame++;
+        for (auto &item : entries) {
+            Entry &entry = item.second;
+            entry.needed_level = needed_level(entry);
+            if (entry.coverage > 0.0f) {
+                entry.last_needed_frame = frame;
+            }
+            entry.coverage = 0.0f;
+        }
+
+        collect_jobs();
+
+        // upload finished levels coarse to fine, so that the resident levels stay a complete chain;
+        // a level started within the budget is uploaded whole, however large
+        std::size_t n_uploaded_bytes = 0;
+        for (auto &item : entries) {
+            Entry &entry = item.second;
+            while (!entry.streamed.empty() && n_uploaded_bytes < upload_budget_bytes) {
+                const Level &level = entry.streamed.back();
+                upload(entry, level);
+                n_uploaded_bytes += level.pixels.size();
+                n_resident_bytes += level.pixels.size();
+                n_pending_bytes -= level.pixels.size();
+                n_streamed_bytes += level.pixels.size();
+                on_resize(item.first, level.pixels.size(), std::size_t(0));
+                entry.streamed.pop_back();
+            }
+        }
+
+        // the next level of every texture that needs more, room for it is made below
+        std::size_t n_demanded_bytes = 0;
+        for (const auto &item : entries) {
+            const Entry &entry = item.second;
+            if (!entry.loading && !entry.failed && entry.needed_level < entry.base_level) {
+                n_demanded_bytes += level_size(entry.source.format, entry.source.width, entry.source.height, entry.base_level - 1);
+            }
+        }
+
+        // drop levels nobody needs, textures out of sight the longest first
+        while (n_resident_bytes + n_pending_bytes + n_demanded_bytes > budget_bytes) {
+            Entry *victim = nullptr;
+            std::uint64_t victim_key = 0;
+            for (auto &item : entries) {
+                Entry &entry = item.second;
+                if (entry.loading || entry.base_level >= entry.needed_level) {
+                    continue;
+                }
+                if (!victim || entry.last_needed_frame < victim->last_needed_frame) {
+                    victim = &entry;
+                    victim_key = item.first;
+                }
+            }
+            if (!victim) {
+                break;
+            }
+            const std::size_t n_bytes = level_size(victim->source.format, victim->source.width, victim->source.height, victim->base_level);
+            drop_finest_level(*victim);
+            n_resident_bytes -= n_bytes;
+            n_dropped_bytes += n_bytes;
+            on_resize(victim_key, std::size_t(0), n_bytes);
+        }
+
+        // start loading the missing levels of textures that need them, as far as the budget allows
+        for (auto &item : entries) {
+            Entry &entry = item.second;
+            if (n_jobs >= max_jobs) {
+                break;
+            }
+            if (entry.loading || entry.failed || entry.needed_level >= entry.base_level) {
+                continue;
+            }
+            int first_level = entry.base_level;
+            std::size_t n_bytes = 0;
+            while (first_level > entry.needed_level) {
+                const std::size_t size = level_size(entry.source.format, entry.source.width, entry.source.height, first_level - 1);
+                if (n_resident_bytes + n_pending_bytes + n_bytes + size > budget_bytes) {
+                    break;
+                }
+                n_bytes += size;
+                first_level--;
+            }
+            if (first_level == entry.base_level) {
+                continue;
+            }
+            start_job(item.first, entry, first_level, entry.base_level - 1, n_bytes);
+        }
+    }
+
+    void set_upload_budget(std::size_t upload_budget_bytes) {
+        this->upload_budget_bytes = upload_budget_bytes;
+    }
+
+    std::size_t get_upload_budget() const {
+        return upload_budget_bytes;
+    }
+
+    std::size_t get_streaming_count() const {
+        return entries.size();
+    }
+
+    std::size_t get_job_count() const {
+        return n_jobs;
+    }
+
+    // levels being loaded or waiting for their upload
+    std::size_t get_pending_bytes() const {
+        return n_pending_bytes;
+    }
+
+    std::size_t get_streamed_bytes() const {
+        return n_streamed_bytes;
+    }
+
+    std::size_t get_dropped_bytes() const {
+        return n_dropped_bytes;
+    }
+
+private:
+    struct Level {
+        int level;
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    struct Entry {
+        GLuint texture = 0;
+        Source source;
+        int n_levels = 1;
+        // finest resident level, GL_TEXTURE_BASE_LEVEL
+        int base_level = 0;
+        // finest level needed by the last frame
+        int needed_level = 0;
+        float coverage = 0.0f;
+        std::size_t last_needed_frame = 0;
+        // a job is running or its levels wait for upload
+        bool loading = false;
+        // the source could not be read, the texture stays as it is
+        bool failed = false;
+        // loaded levels waiting for upload, finest first
+        std::vector<Level> streamed;
+    };
+
+    struct Job {
+        std::uint64_t key;
+        GLuint texture;
+        std::size_t n_bytes;
+        std::future<std::vector<Level>> levels;
+    };
+
+    // results stay in flight for a frame or two, a few jobs keep the thread pool free for model loading
+    static constexpr std::size_t max_jobs = 4;
+
+    std::unordered_map<std::uint64_t, Entry> entries;
+    std::vector<Job> jobs;
+    TextureCompressor compressor;
+    GLBuffer pixel_buffer;
+    std::size_t upload_budget_bytes = 8u << 20;
+    std::size_t frame = 0;
+    std::size_t n_jobs = 0;
+    // loaded or loading, but not uploaded yet
+    std::size_t n_pending_bytes = 0;
+    std::size_t n_streamed_bytes = 0;
+    std::size_t n_dropped_bytes = 0;
+
+    // the texture is assumed to span its mesh once, so that one texel per pixel
+    // needs max(width, height) / pixels texels along the mesh
+    static int needed_level(const Entry &entry) {
+        if (entry.coverage <= 0.0f) {
+            return entry.n_levels - 1;
+        }
+        const float texels = static_cast<float>(std::max(entry.source.width, entry.source.height));
+        const int level = static_cast<int>(std::floor(std::log2(std::max(texels / entry.coverage, 1.0f))));
+        return std::clamp(level, 0, entry.n_levels - 1);
+    }
+
+    void start_job(std::uint64_t key, Entry &entry, int first_level, int last_level, std::size_t n_bytes) {
+        entry.loading = true;
+        n_pending_bytes += n_bytes;
+        n_jobs++;
+        Job job;
+        job.key = key;
+        job.texture = entry.texture;
+        job.n_bytes = n_bytes;
+        job.levels = ThreadPool::instance().submit([compressor = compressor, source = entry.source, first_level, last_level] {
+            return load_levels(compressor, source, first_level, last_level);
+        });
+        jobs.push_back(std::move(job));
+    }
+
+    void collect_jobs() {
+        for (auto it = jobs.begin(); it != jobs.end(); ) {
+            if (it->levels.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                ++it;
+                continue;
+            }
+            std::vector<Level> levels = it->levels.get();
+            n_jobs--;
+            auto entry = entries.find(it->key);
+            // removed, or removed and added again while the job was running
+            if (entry == entries.end() || entry->second.texture != it->texture || !entry->second.loading) {
+                n_pending_bytes -= it->n_bytes;
+            } else if (levels.empty()) {
+                std::cerr << "[TextureStreamer] failed to load the mip levels of " << entry->second.source.filepath << std::endl;
+                entry->second.failed = true;
+                entry->second.loading = false;
+                n_pending_bytes -= it->n_bytes;
+            } else {
+                entry->second.streamed = std::move(levels);
+            }
+            it = jobs.erase(it);
+        }
+
+        for (auto &item : entries) {
+            Entry &entry = item.second;
+            if (entry.loading && entry.streamed.empty() && !has_job(item.first)) {
+                entry.loading = false;
+            }
+        }
+    }
+
+    void release_streamed(Entry &entry) {
+        for (const auto &level : entry.streamed) {
+            n_pending_bytes -= level.pixels.size();
+        }
+        entry.streamed.clear();
+    }
+
+    bool has_job(std::uint64_t key) const {
+        for (const auto &job : jobs) {
+            if (job.key == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // worker thread, levels first_level..last_level, finest first; empty on failure
+    static std::vector<Level> load_levels(const TextureCompressor &compressor, const Source &source, int first_level, int last_level) {
+        std::vector<Level> levels;
+        if (source.format != 0) {
+            CompressedImage image;
+            if (!compressor.load(source.content_hash, image, 1 << 30, first_level) || image.first_level != first_level ||
+                image.levels.size() < static_cast<std::size_t>(last_level - first_level + 1)) {
+                return {};
+            }
+            for (int level = first_level; level <= last_level; ++level) {
+                const CompressedImage::Level &l = image.levels[level - first_level];
+                const unsigned char *data = image.data.data() + l.offset;
+                levels.push_back({level, l.width, l.height, std::vector<unsigned char>(data, data + l.size)});
+            }
+            return levels;
+        }
+
+        TextureData texture;
+        texture.filepath = source.filepath;
+        if (!texture.decode() || texture.width != source.width || texture.height != source.height) {
+            return {};
+        }
+        for (int level = first_level; level <= last_level; ++level) {
+            texture.reduce(level);
+            const std::size_t size = level_size(0, source.width, source.height, level);
+            levels.push_back({
+                level,
+                TextureData::level_width(source.width, level),
+                TextureData::level_width(source.height, level),
+                std::vector<unsigned char>(texture.pixels.get(), texture.pixels.get() + size)
+            });
+        }
+        return levels;
+    }
+
+    // copies the level into the pixel unpack buffer, the texture is then filled from there
+    void upload(Entry &entry, const Level &level) {
+        if (pixel_buffer == 0) {
+            pixel_buffer.create();
+        }
+        const GLsizeiptr size = static_cast<GLsizeiptr>(level.pixels.size());
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+        // orphan the previous upload instead of waiting for it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped) {
+            std::memcpy(mapped, level.pixels.data(), level.pixels.size());
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        } else {
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, level.pixels.data());
+        }
+
+        glBindTexture(GL_TEXTURE_2D, entry.texture);
+        if (entry.source.format != 0) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level.level, entry.source.format, level.width, level.height, 0,
+                                   static_cast<GLsizei>(size), nullptr);
+        } else {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, level.level, GL_RGB, level.width, level.height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level.level);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        entry.base_level = level.level;
+    }
+
+    // GL has no way to free a single level other than respecifying it empty
+    void drop_finest_level(Entry &entry) {
+        const int level = entry.base_level;
+        glBindTexture(GL_TEXTURE_2D, entry.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+        if (entry.source.format != 0) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, entry.source.format, 0, 0, 0, 0, nullptr);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        entry.base_level = level + 1;
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// fixed-size pool of worker threads for CPU side work that must stay off the GL thread
+class ThreadPool {
+public:
+    ThreadPool(std::size_t n_threads) {
+        n_threads = std::max<std::size_t>(n_threads, 1);
+        for (std::size_t i = 0; i < n_threads; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    // process-wide pool, one thread is left for the GL thread
+    static ThreadPool &instance() {
+        static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+        return pool;
+    }
+
+    std::size_t size() const {
+        return workers.size();
+    }
+
+    template <typename F>
+    auto submit(F &&task) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged] { (*packaged)(); });
+        }
+        condition.notify_one();
+        return future;
+    }
+
+    // runs body(i) for every i in [0, n) on the pool and the calling thread; the caller takes items
+    // itself instead of blocking on queued tasks, so this is safe to call from a worker thread
+    template <typename F>
+    void parallel_for(std::size_t n, F &&body) {
+        struct State {
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> n_done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<State>();
+
+        // helpers that start after every item was taken return without touching body
+        auto run = [state, n, &body] {
+            for (std::size_t i = state->next++; i < n; i = state->next++) {
+                body(i);
+                if (++state->n_done == n) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+        const std::size_t n_helpers = std::min(workers.size(), n > 0 ? n - 1 : 0);
+        for (std::size_t i = 0; i < n_helpers; ++i) {
+            submit(run);
+        }
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&] { return state->n_done == n; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return ;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <zmv/gl_object.h>
+
+// per-frame storage for data that changes every frame (camera, instance matrices), written once
+// per frame and bound by offset; usable as GL_UNIFORM_BUFFER and GL_ARRAY_BUFFER
+//
+// with ARB_buffer_storage the buffer is persistently mapped and split into one region per frame
+// in flight, a fence per region keeps the CPU from overwriting data the GPU still reads;
+// otherwise writes go to a CPU copy that flush() uploads with one orphaning glBufferSubData
+class UniformRing {
+public:
+    static constexpr std::size_t n_regions = 3;
+
+    UniformRing() { }
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    static bool is_persistent_supported() {
+#ifdef GL_ARB_buffer_storage
+        GLint n_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+        for (GLint i = 0; i < n_extensions; ++i) {
+            const char *name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && std::strcmp(name, "GL_ARB_buffer_storage") == 0) {
+                return true;
+            }
+        }
+#endif
+        return false;
+    }
+
+    // region_size bytes per frame, grown by begin_frame when a frame needs more;
+    // every call replaces the buffer and starts a new generation
+    void create(std::size_t region_size, bool persistent) {
+        destroy();
+        generation++;
+        GLint offset_alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+        alignment = static_cast<std::size_t>(std::max(offset_alignment, 16));
+        this->region_size = aligned_size(region_size);
+        this->persistent = persistent;
+
+        buffer.create();
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+#ifdef GL_ARB_buffer_storage
+        if (persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, this->region_size * n_regions, nullptr, flags);
+            mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, this->region_size * n_regions, flags));
+            if (!mapped) {
+                std::cerr << "[UniformRing] failed to map the buffer persistently, falling back to glBufferSubData" << std::endl;
+                this->persistent = false;
+                buffer.create();
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            }
+        }
+#else
+        this->persistent = false;
+#endif
+        if (!this->persistent) {
+            glBufferData(GL_UNIFORM_BUFFER, this->region_size, nullptr, GL_STREAM_DRAW);
+            staging.resize(this->region_size);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        region = 0;
+        n_used = 0;
+    }
+
+    void destroy() {
+        for (auto &fence : fences) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        if (mapped) {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            mapped = nullptr;
+        }
+        buffer.reset();
+        staging = {};
+    }
+
+    bool is_persistent() const {
+        return persistent;
+    }
+
+    GLuint get_buffer() const {
+        return buffer;
+    }
+
+    // changes whenever the buffer is replaced; glGenBuffers usually hands out the deleted name
+    // again, so vertex arrays pointing into the ring cannot tell from the name alone
+    std::uint64_t get_generation() const {
+        return generation;
+    }
+
+    // bytes an allocation of n bytes takes, offsets are kept at GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    std::size_t aligned_size(std::size_t n_bytes) const {
+        return (n_bytes + alignment - 1) / alignment * alignment;
+    }
+
+    // starts writing the next region; n_bytes is an upper bound of what the frame allocates
+    void begin_frame(std::size_t n_bytes) {
+        if (n_bytes > region_size) {
+            // no region may still be in use by the GPU when the buffer is replaced
+            for (auto &fence : fences) {
+                wait(fence);
+            }
+            create(std::max(n_bytes, 2 * region_size), persistent);
+        }
+        if (persistent) {
+            region = (region + 1) % n_regions;
+            wait(fences[region]);
+        }
+        n_used = 0;
+    }
+
+    // nullptr data when the frame's bound was too small; the offset is relative to the buffer
+    struct Allocation {
+        GLintptr offset = 0;
+        void *data = nullptr;
+    };
+
+    Allocation allocate(std::size_t n_bytes) {
+        Allocation allocation;
+        const std::size_t size = aligned_size(n_bytes);
+        if (n_used + size > region_size) {
+            std::cerr << "[UniformRing] frame allocation of " << n_bytes << " bytes does not fit" << std::endl;
+            return allocation;
+        }
+        const std::size_t region_offset = persistent ? region * region_size : 0;
+        allocation.offset = static_cast<GLintptr>(region_offset + n_used);
+        allocation.data = persistent ? mapped + region_offset + n_used : staging.data() + n_used;
+        n_used += size;
+        return allocation;
+    }
+
+    // copies n values into the frame, -1 when they do not fit
+    template <typename T>
+    GLintptr write(const T *values, std::size_t n) {
+        const Allocation allocation = allocate(n * sizeof(T));
+        if (!allocation.data) {
+            return -1;
+        }
+        std::memcpy(allocation.data, values, n * sizeof(T));
+        return allocation.offset;
+    }
+
+    // before the first draw reading this frame's data
+    void flush() {
+        n_uploaded = n_used;
+        if (persistent || n_used == 0) {
+            return ;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, region_size, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, n_used, staging.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // after the last draw reading this frame's data
+    void end_frame() {
+        if (!persistent) {
+            return ;
+        }
+        if (fences[region]) {
+            glDeleteSync(fences[region]);
+        }
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // bytes written by the last frame
+    std::size_t get_frame_bytes() const {
+        return n_uploaded;
+    }
+
+    std::size_t get_capacity() const {
+        return persistent ? region_size * n_regions : region_size;
+    }
+
+    // begin_frame calls that found the GPU still reading the region
+    std::size_t get_stall_count() const {
+        return n_stalls;
+    }
+
+private:
+    GLBuffer buffer;
+    std::uint64_t generation = 0;
+    bool persistent = false;
+    std::size_t alignment = 256;
+    std::size_t region_size = 0;
+    std::size_t region = 0;
+    std::size_t n_used = 0;
+    std::size_t n_uploaded = 0;
+    std::size_t n_stalls = 0;
+    unsigned char *mapped = nullptr;
+    std::vector<unsigned char> staging;
+    std::array<GLsync, n_regions> fences{};
+
+    void wait(GLsync &fence) {
+        if (!fence) {
+            return ;
+        }
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            n_stalls++;
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+};
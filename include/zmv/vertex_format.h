@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 tex_coords;
+};
+
+// 16 byte vertex: positions as unorm16 inside the model's bounding box, octahedral normals
+// as snorm16 and half float texture coordinates; shader.vert decodes it
+struct CompactVertex {
+    std::uint16_t position[4]; // the fourth component only pads the normal to 4 bytes
+    std::int16_t normal[2];
+    std::uint16_t tex_coords[2];
+};
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex is uploaded as raw bytes");
+
+// maps unorm16 positions back to model space: position = offset + scale * quantized
+struct VertexQuantization {
+    glm::vec3 offset{0.0f};
+    glm::vec3 scale{1.0f};
+
+    static VertexQuantization from_bounds(const glm::vec3 &min, const glm::vec3 &max) {
+        VertexQuantization quantization;
+        quantization.offset = min;
+        // flat boxes keep a non zero scale so that encoding does not divide by zero
+        quantization.scale = glm::max(max - min, glm::vec3(1e-20f));
+        return quantization;
+    }
+
+    CompactVertex compress(const Vertex &vertex) const {
+        CompactVertex compact;
+        const glm::vec3 normalized = (vertex.position - offset) / scale;
+        for (int i = 0; i < 3; ++i) {
+            compact.position[i] = static_cast<std::uint16_t>(std::lround(std::clamp(normalized[i], 0.0f, 1.0f) * 65535.0f));
+        }
+        compact.position[3] = 0;
+
+        const glm::vec2 octahedral = encode_octahedral(vertex.normal);
+        compact.normal[0] = static_cast<std::int16_t>(std::lround(octahedral.x * 32767.0f));
+        compact.normal[1] = static_cast<std::int16_t>(std::lround(octahedral.y * 32767.0f));
+
+        compact.tex_coords[0] = to_half(vertex.tex_coords.x);
+        compact.tex_coords[1] = to_half(vertex.tex_coords.y);
+        return compact;
+    }
+
+    // unit vector to the [-1, 1]^2 square by projecting onto the octahedron and folding the lower half
+    static glm::vec2 encode_octahedral(const glm::vec3 &normal) {
+        const float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        if (length == 0.0f) {
+            return glm::vec2(0.0f, 0.0f);
+        }
+        glm::vec2 result(normal.x / length, normal.y / length);
+        if (normal.z < 0.0f) {
+            const glm::vec2 folded(
+                (1.0f - std::fabs(result.y)) * (result.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - std::fabs(result.x)) * (result.y >= 0.0f ? 1.0f : -1.0f)
+            );
+            result = folded;
+        }
+        return result;
+    }
+
+    // IEEE 754 binary16 with round to nearest even, out of range values become infinity
+    static std::uint16_t to_half(float value) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const std::uint32_t sign = (bits >> 16) & 0x8000u;
+        const std::uint32_t magnitude = bits & 0x7fffffffu;
+
+        if (magnitude >= 0x7f800000u) {
+            // inf stays inf, NaN stays NaN
+            return static_cast<std::uint16_t>(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+        }
+        if (magnitude >= 0x477ff000u) {
+            // rounds to more than the largest half
+            return static_cast<std::uint16_t>(sign | 0x7c00u);
+        }
+        if (magnitude < 0x38800000u) {
+            // subnormal half or zero
+            if (magnitude < 0x33000000u) {
+                return static_cast<std::uint16_t>(sign);
+            }
+            const std::uint32_t exponent = magnitude >> 23;
+            const std::uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+            const std::uint32_t shift = 126u - exponent;
+            std::uint32_t half = mantissa >> shift;
+            const std::uint32_t remainder = mantissa & ((1u << shift) - 1u);
+            const std::uint32_t halfway = 1u << (shift - 1u);
+            if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+                half++;
+            }
+            return static_cast<std::uint16_t>(sign | half);
+        }
+
+        // normal half, rebias the exponent and round the mantissa from 23 to 10 bits
+        std::uint32_t half = (magnitude - 0x38000000u) >> 13;
+        const std::uint32_t remainder = magnitude & 0x1fffu;
+        if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+            half++;
+        }
+        return static_cast<std::uint16_t>(sign | half);
+    }
+};
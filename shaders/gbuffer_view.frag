@@ -0,0 +1,50 @@
+#version 330 core
+in vec2 uv;
+
+out vec4 fragColor;
+
+// position, normal, texture coords, diffuse, specular; in RenderMode order
+uniform sampler2D gbuffer[5];
+// a RenderMode, or -1 for all of them in a 3 x 2 grid
+uniform int gbufferChannel;
+
+vec4 sampleGBuffer(int channel, vec2 uv) {
+    switch (channel) {
+        case 0: return texture(gbuffer[0], uv);
+        case 1: return texture(gbuffer[1], uv);
+        case 2: return texture(gbuffer[2], uv);
+        case 3: return texture(gbuffer[3], uv);
+        default: return texture(gbuffer[4], uv);
+    }
+}
+
+void main() {
+    int channel = gbufferChannel;
+    vec2 cellUV = uv;
+    if (channel < 0) {
+        // top row position, normal, texture coords; bottom row diffuse, specular
+        vec2 cell = min(floor(uv * vec2(3.0, 2.0)), vec2(2.0, 1.0));
+        channel = int(cell.x) + 3 * (1 - int(cell.y));
+        cellUV = uv * vec2(3.0, 2.0) - cell;
+        if (channel > 4) {
+            discard;
+        }
+    }
+
+    // the background is left to the target's clear color
+    if (texture(gbuffer[0], cellUV).w == 0.0) {
+        discard;
+    }
+
+    // the same colors as the forward fragment shaders
+    vec4 value = sampleGBuffer(channel, cellUV);
+    if (channel == 1) {
+        fragColor = vec4(0.5 * (value.xyz + 1.0), 1.0);
+    } else if (channel == 2) {
+        fragColor = vec4(value.xy, 0.0, 1.0);
+    } else if (channel == 3 || channel == 4) {
+        fragColor = value;
+    } else {
+        fragColor = vec4(value.xyz, 1.0);
+    }
+}
@@ -0,0 +1,89 @@
+#version 330 core
+// every forward RenderMode and the G-buffer pass from one source; ShaderLibrary defines one
+// PASS_* and the material features (HAS_DIFFUSE_TEXTURE, HAS_SPECULAR_TEXTURE) of the variant
+in vec3 position;
+in vec3 normal;
+in vec2 texCoords;
+
+#ifdef PASS_GBUFFER
+// every RenderMode at once, see GBuffer; gPosition.w marks covered pixels
+layout (location = 0) out vec4 gPosition;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec2 gTexCoords;
+layout (location = 3) out vec4 gDiffuse;
+layout (location = 4) out vec4 gSpecular;
+#else
+out vec4 fragColor;
+#endif
+
+layout (std140) uniform MaterialBlock {
+    vec4 kd;
+    vec4 ks;
+    vec4 ka;
+    float shininess;
+    // units of materialTextures, -1 without a texture
+    int diffuseTexture;
+    int specularTexture;
+};
+
+#if defined(HAS_DIFFUSE_TEXTURE) || defined(HAS_SPECULAR_TEXTURE)
+// all textures of the model, bound once; GLSL 3.30 only allows constant sampler array indices
+uniform sampler2D materialTextures[16];
+
+vec4 sampleMaterialTexture(int unit, vec2 uv) {
+    switch (unit) {
+        case 0: return texture(materialTextures[0], uv);
+        case 1: return texture(materialTextures[1], uv);
+        case 2: return texture(materialTextures[2], uv);
+        case 3: return texture(materialTextures[3], uv);
+        case 4: return texture(materialTextures[4], uv);
+        case 5: return texture(materialTextures[5], uv);
+        case 6: return texture(materialTextures[6], uv);
+        case 7: return texture(materialTextures[7], uv);
+        case 8: return texture(materialTextures[8], uv);
+        case 9: return texture(materialTextures[9], uv);
+        case 10: return texture(materialTextures[10], uv);
+        case 11: return texture(materialTextures[11], uv);
+        case 12: return texture(materialTextures[12], uv);
+        case 13: return texture(materialTextures[13], uv);
+        case 14: return texture(materialTextures[14], uv);
+        default: return texture(materialTextures[15], uv);
+    }
+}
+#endif
+
+vec4 diffuseColor() {
+#ifdef HAS_DIFFUSE_TEXTURE
+    return sampleMaterialTexture(diffuseTexture, texCoords);
+#else
+    return vec4(kd.rgb, 1.0);
+#endif
+}
+
+vec4 specularColor() {
+#ifdef HAS_SPECULAR_TEXTURE
+    return sampleMaterialTexture(specularTexture, texCoords);
+#else
+    return vec4(ks.rgb, 1.0);
+#endif
+}
+
+void main() {
+#if defined(PASS_POSITION)
+    fragColor = vec4(position, 1.0);
+#elif defined(PASS_NORMAL)
+    fragColor = vec4(0.5 * (normal + 1.0), 1.0);
+#elif defined(PASS_TEXCOORDS)
+    fragColor = vec4(texCoords, 0.0, 1.0);
+#elif defined(PASS_DIFFUSE)
+    fragColor = diffuseColor();
+#elif defined(PASS_SPECULAR)
+    fragColor = specularColor();
+#elif defined(PASS_GBUFFER)
+    gPosition = vec4(position, 1.0);
+    gNormal = vec4(normal, 0.0);
+    gTexCoords = texCoords;
+    gDiffuse = diffuseColor();
+    gSpecular = specularColor();
+#endif
+}
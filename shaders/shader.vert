@@ -1,7 +1,10 @@
 #version 330 core
 layout (location = 0) in vec3 vPosition;
+// xyz, or an octahedral encoded normal in xy
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec2 vTexCoords;
+// per instance, translation and uniform scale, see Scene
+layout (location = 3) in mat4 instanceMatrix;
 
 out vec3 position;
 out vec3 normal;
@@ -12,9 +15,31 @@ layout (std140) uniform CameraBlock {
     mat4 projection;
 };
 
+#ifdef COMPACT_VERTICES
+// compact vertices store positions relative to the model's bounding box
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#endif
+
 void main() {
-    gl_Position = projection * view * vec4(vPosition, 1.0);
-    position = vPosition;
-    normal = vNormal;
+#ifdef COMPACT_VERTICES
+    vec3 modelPosition = positionOffset + positionScale * vPosition;
+    vec3 modelNormal = decodeOctahedral(vNormal.xy);
+#else
+    vec3 modelPosition = vPosition;
+    vec3 modelNormal = vNormal;
+#endif
+    vec4 worldPosition = instanceMatrix * vec4(modelPosition, 1.0);
+    gl_Position = projection * view * worldPosition;
+    position = worldPosition.xyz;
+    normal = normalize(mat3(instanceMatrix) * modelNormal);
     texCoords = vTexCoords;
 }
@@ -0,0 +1,42 @@
+#version 330 core
+in vec2 uv;
+
+out vec4 fragColor;
+
+// the model rendered at a lower resolution, with bilinear filtering
+uniform sampler2D source;
+// size of source in texels
+uniform vec2 sourceSize;
+
+// Catmull-Rom over the 4 x 4 texels around uv, in 9 bilinear taps: the middle two weights of
+// each axis are positive and have the same sign, so one bilinear tap between them replaces two
+void main() {
+    vec2 samplePosition = uv * sourceSize;
+    vec2 texel1 = floor(samplePosition - 0.5) + 0.5;
+    vec2 f = samplePosition - texel1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 offset12 = w2 / w12;
+
+    vec2 uv0 = (texel1 - 1.0) / sourceSize;
+    vec2 uv3 = (texel1 + 2.0) / sourceSize;
+    vec2 uv12 = (texel1 + offset12) / sourceSize;
+
+    vec4 color =
+        texture(source, vec2(uv0.x, uv0.y)) * w0.x * w0.y +
+        texture(source, vec2(uv12.x, uv0.y)) * w12.x * w0.y +
+        texture(source, vec2(uv3.x, uv0.y)) * w3.x * w0.y +
+        texture(source, vec2(uv0.x, uv12.y)) * w0.x * w12.y +
+        texture(source, vec2(uv12.x, uv12.y)) * w12.x * w12.y +
+        texture(source, vec2(uv3.x, uv12.y)) * w3.x * w12.y +
+        texture(source, vec2(uv0.x, uv3.y)) * w0.x * w3.y +
+        texture(source, vec2(uv12.x, uv3.y)) * w12.x * w3.y +
+        texture(source, vec2(uv3.x, uv3.y)) * w3.x * w3.y;
+    // the negative lobes overshoot at hard edges
+    fragColor = clamp(color, 0.0, 1.0);
+}
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <memory>
 
@@ -9,7 +12,11 @@
 
 #include <zmv/camera.h>
 #include <zmv/model.h>
+#include <zmv/profiler.h>
+#include <zmv/render_target.h>
 #include <zmv/renderer.h>
+#include <zmv/resolution_scaler.h>
+#include <zmv/texture_cache.h>
 
 int width = 1600;
 int height = 900;
@@ -17,30 +24,48 @@ std::unique_ptr<Renderer> renderer;
 
 GLFWwindow *window = nullptr;
 
+// the model is drawn into model_target only when the renderer has something new to show,
+// other frames copy it to the window and draw ImGui on top
+RenderTarget model_target;
+const int model_samples = 4;
+std::size_t n_frames = 0;
+std::size_t n_redraws = 0;
+
+// with dynamic resolution model_target is smaller than the window and upscaled into it,
+// ImGui is always drawn at the window resolution
+ResolutionScaler resolution_scaler;
+
+// with nothing to redraw the loop sleeps in glfwWaitEventsTimeout; after input it keeps running
+// a few frames, ImGui needs them to settle hover and click states
+const double idle_timeout_seconds = 0.5;
+const int frames_after_input = 3;
+int active_frames = frames_after_input;
+
 void handleInput(GLFWwindow *window, const ImGuiIO &io) {
     // close app
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
 
-    // camera movement
+    // camera movement; the first frame after an idle wait would otherwise move by the whole wait
+    const float delta_time = std::min(io.DeltaTime, 0.1f);
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        renderer->move_camera(CameraMovement::Forward, io.DeltaTime);
+        renderer->move_camera(CameraMovement::Forward, delta_time);
     }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        renderer->move_camera(CameraMovement::Left, io.DeltaTime);
+        renderer->move_camera(CameraMovement::Left, delta_time);
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        renderer->move_camera(CameraMovement::Backward, io.DeltaTime);
+        renderer->move_camera(CameraMovement::Backward, delta_time);
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        renderer->move_camera(CameraMovement::Right, io.DeltaTime);
+        renderer->move_camera(CameraMovement::Right, delta_time);
     }
     if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
-        renderer->move_camera(CameraMovement::Up, io.DeltaTime);
+        renderer->move_camera(CameraMovement::Up, delta_time);
     }
     if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
-        renderer->move_camera(CameraMovement::Down, io.DeltaTime);
+        renderer->move_camera(CameraMovement::Down, delta_time);
     }
 
     // camera look around
@@ -54,7 +79,33 @@ void framebufferSizeCallback(GLFWwindow* window, int new_width, int new_height)
     width = new_width;
     height = new_height;
     glViewport(0, 0, width, height);
-    renderer->set_resulution(width, height);
+    // the renderer gets the scaled size from end_frame, with model_target
+    active_frames = frames_after_input;
+}
+
+// installed before ImGui's callbacks, which call them after their own
+void cursorPosCallback(GLFWwindow* window, double x, double y) {
+    active_frames = frames_after_input;
+}
+
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+    active_frames = frames_after_input;
+}
+
+void scrollCallback(GLFWwindow* window, double x_offset, double y_offset) {
+    active_frames = frames_after_input;
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    active_frames = frames_after_input;
+}
+
+void charCallback(GLFWwindow* window, unsigned int c) {
+    active_frames = frames_after_input;
+}
+
+void windowFocusCallback(GLFWwindow* window, int focused) {
+    active_frames = frames_after_input;
 }
 
 bool initialize() {
@@ -63,7 +114,8 @@ bool initialize() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
+    // multisampling happens in model_target, which is resolved into the window
+    glfwWindowHint(GLFW_SAMPLES, 0);
 
     window = glfwCreateWindow(width, height, "zmv", nullptr, nullptr);
     if (window == nullptr) {
@@ -74,6 +126,12 @@ bool initialize() {
 
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+    glfwSetCursorPosCallback(window, cursorPosCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetScrollCallback(window, scrollCallback);
+    glfwSetKeyCallback(window, keyCallback);
+    glfwSetCharCallback(window, charCallback);
+    glfwSetWindowFocusCallback(window, windowFocusCallback);
     if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
         std::cerr << "failed to load glad" << std::endl;
         glfwTerminate();
@@ -84,7 +142,10 @@ bool initialize() {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_MULTISAMPLE);
 
+    const auto renderer_start = std::chrono::steady_clock::now();
     renderer = std::make_unique<Renderer>(width, height);
+    const std::chrono::duration<double, std::milli> renderer_time = std::chrono::steady_clock::now() - renderer_start;
+    std::cout << "[zmv] renderer setup: " << renderer_time.count() << " ms" << std::endl;
 
     std::cout << "GL_VERSION: " << glGetString(GL_VERSION) << std::endl;
     std::cout << "GL_VENDOR: " << glGetString(GL_VENDOR) <<  std::endl;
@@ -107,12 +168,79 @@ bool initialize() {
 }
 
 void begin_frame() {
-    glfwPollEvents();
+    // waiting is not part of the frame
+    if (active_frames > 0 || renderer->needs_redraw() || renderer->is_busy()) {
+        glfwPollEvents();
+    } else {
+        glfwWaitEventsTimeout(idle_timeout_seconds);
+    }
+    if (active_frames > 0) {
+        active_frames--;
+    }
+    Profiler::instance().begin_frame();
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 }
 
+void profiler_UI() {
+    if (!ImGui::CollapsingHeader("profiler")) {
+        return ;
+    }
+    Profiler &profiler = Profiler::instance();
+
+    static bool profiler_enabled = profiler.is_enabled();
+    if (ImGui::Checkbox("enabled", &profiler_enabled)) {
+        profiler.set_enabled(profiler_enabled);
+    }
+    ImGui::SameLine();
+    static bool mesh_timing = false;
+    if (ImGui::Checkbox("time mesh groups", &mesh_timing)) {
+        profiler.set_mesh_timing(mesh_timing);
+    }
+
+    // rolling frame graph
+    const std::vector<float> &cpu_history = profiler.get_cpu_frame_history();
+    const std::vector<float> &gpu_history = profiler.get_gpu_frame_history();
+    if (!cpu_history.empty()) {
+        char overlay[32];
+        std::snprintf(overlay, sizeof(overlay), "%.2f ms", cpu_history.back());
+        ImGui::PlotLines("CPU frame", cpu_history.data(), static_cast<int>(cpu_history.size()), 0, overlay, 0.0f, 33.3f, ImVec2(0.0f, 60.0f));
+        std::snprintf(overlay, sizeof(overlay), "%.2f ms", gpu_history.back());
+        ImGui::PlotLines("GPU frame", gpu_history.data(), static_cast<int>(gpu_history.size()), 0, overlay, 0.0f, 33.3f, ImVec2(0.0f, 60.0f));
+    }
+
+    // passes of the last resolved frame, mesh groups are listed separately below
+    ImGui::Text("%-24s %9s %9s", "scope", "CPU ms", "GPU ms");
+    for (const auto &scope : profiler.get_last_scopes()) {
+        if (scope.index >= 0) {
+            continue;
+        }
+        const int indent = std::min(scope.depth, 8) * 2;
+        if (scope.gpu_milliseconds >= 0.0) {
+            ImGui::Text("%*s%-*s %9.3f %9.3f", indent, "", 24 - indent, scope.name, scope.cpu_milliseconds, scope.gpu_milliseconds);
+        } else {
+            ImGui::Text("%*s%-*s %9.3f %9s", indent, "", 24 - indent, scope.name, scope.cpu_milliseconds, "-");
+        }
+    }
+
+    // most expensive mesh groups, packed geometry draws groups and the per-mesh path draws meshes
+    if (profiler.is_mesh_timing_enabled()) {
+        const std::size_t top_n = 10;
+        std::vector<Profiler::ScopeTiming> top = profiler.top_scopes("mesh group", top_n);
+        if (top.empty()) {
+            top = profiler.top_scopes("mesh", top_n);
+        }
+        for (const auto &scope : top) {
+            ImGui::Text("%-14s %4d %9.3f ms", scope.name, scope.index, scope.gpu_milliseconds);
+        }
+    }
+
+    if (ImGui::Button("dump chrome trace")) {
+        profiler.write_chrome_trace("zmv_trace.json");
+    }
+}
+
 void UI() {
     ImGui::Begin("zmv");
 
@@ -134,12 +262,139 @@ void UI() {
     if (ImGui::Button("load model")) {
         renderer->load_model(model_filepath);
     }
+    ImGui::SameLine();
+    if (ImGui::Button("add to scene")) {
+        renderer->add_model(model_filepath);
+    }
+    static LoadOptions load_options = renderer->get_load_options();
+    if (ImGui::Checkbox("packed geometry", &load_options.packed_geometry)) {
+        // takes effect by reloading the current model
+        renderer->set_load_options(load_options);
+        renderer->load_model(model_filepath);
+    }
+    ImGui::SameLine();
+    if (ImGui::Checkbox("compact vertices", &load_options.compact_vertices)) {
+        renderer->set_load_options(load_options);
+        renderer->load_model(model_filepath);
+    }
+    ImGui::SameLine();
+    if (ImGui::Checkbox("16 bit indices", &load_options.short_indices)) {
+        renderer->set_load_options(load_options);
+        renderer->load_model(model_filepath);
+    }
+    if (ImGui::Checkbox("fast OBJ loader", &load_options.fast_obj)) {
+        renderer->set_load_options(load_options);
+        renderer->load_model(model_filepath);
+    }
+    if (renderer->is_loading_model()) {
+        ImGui::ProgressBar(renderer->get_loading_progress(), ImVec2(-1.0f, 0.0f), renderer->get_loading_status().c_str());
+    }
+
+    // render statistics
+    const FrameStats &frame_stats = renderer->get_frame_stats();
+    ImGui::Text("draw calls: %zu, state changes: %zu", frame_stats.draw_calls, frame_stats.state_changes);
+    ImGui::Text("  before filtering: %zu, unsorted: %zu", frame_stats.state_changes_requested, frame_stats.state_changes_unsorted);
+    static bool frustum_culling = renderer->get_frustum_culling();
+    if (ImGui::Checkbox("frustum culling", &frustum_culling)) {
+        renderer->set_frustum_culling(frustum_culling);
+    }
+    ImGui::Text("meshes submitted: %zu, culled: %zu", frame_stats.meshes_submitted, frame_stats.meshes_culled);
+    ImGui::Text("instances submitted: %zu, culled: %zu", frame_stats.instances_submitted, frame_stats.instances_culled);
+    ImGui::Text("triangles: %zu", frame_stats.triangles);
+    bool persistent_uniforms = renderer->get_uniform_ring().is_persistent();
+    if (!renderer->is_persistent_uniforms_supported()) {
+        ImGui::BeginDisabled();
+    }
+    if (ImGui::Checkbox("persistent mapped uniforms", &persistent_uniforms)) {
+        renderer->set_persistent_uniforms(persistent_uniforms);
+    }
+    if (!renderer->is_persistent_uniforms_supported()) {
+        ImGui::EndDisabled();
+    }
+    ImGui::Text("uniforms: %.1f KB per frame, %zu stalls", frame_stats.uniform_bytes / 1024.0, renderer->get_uniform_ring().get_stall_count());
+
+    // instancing stress test, applies to the last loaded model
+    static int n_instances = 1000;
+    ImGui::SliderInt("instances", &n_instances, 1, 10000);
+    ImGui::SameLine();
+    if (ImGui::Button("spawn")) {
+        renderer->spawn_instances(static_cast<std::size_t>(n_instances));
+    }
+    ImGui::Text("scene: %zu models, %zu instances", renderer->get_scene().size(), renderer->get_scene().instance_count());
+
+    // vertex cache / overdraw optimization
+    if (ImGui::Checkbox("optimize vertex cache", &load_options.optimize_vertex_cache)) {
+        renderer->set_load_options(load_options);
+        renderer->load_model(model_filepath);
+    }
+    ImGui::SameLine();
+    if (ImGui::Checkbox("optimize overdraw", &load_options.optimize_overdraw)) {
+        renderer->set_load_options(load_options);
+        renderer->load_model(model_filepath);
+    }
+
+    // level of detail
+    if (ImGui::Checkbox("generate LODs", &load_options.generate_lods)) {
+        renderer->set_load_options(load_options);
+        renderer->load_model(model_filepath);
+    }
+    static int lod = renderer->get_forced_lod() + 1;
+    if (ImGui::Combo("LOD", &lod, "auto\0LOD 0\0LOD 1\0LOD 2\0LOD 3\0\0")) {
+        renderer->set_forced_lod(lod - 1);
+    }
+    static float lod_error_pixels = renderer->get_lod_error_pixels();
+    if (ImGui::SliderFloat("LOD error (px)", &lod_error_pixels, 0.1f, 16.0f)) {
+        renderer->set_lod_error_pixels(lod_error_pixels);
+    }
 
     // render mode
     static RenderMode render_mode = renderer->get_render_mode();
     if (ImGui::Combo("render mode", reinterpret_cast<int*>(&render_mode), "Position\0Normal\0TexCoords\0Diffuse\0Specular\0\0")) {
         renderer->set_render_mode(render_mode);
     }
+    static bool deferred = renderer->get_deferred();
+    if (ImGui::Checkbox("deferred (G-buffer)", &deferred)) {
+        renderer->set_deferred(deferred);
+    }
+    if (!deferred) {
+        ImGui::BeginDisabled();
+    }
+    ImGui::SameLine();
+    static bool split_view = renderer->get_split_view();
+    if (ImGui::Checkbox("split view", &split_view)) {
+        renderer->set_split_view(split_view);
+    }
+    if (!deferred) {
+        ImGui::EndDisabled();
+    }
+    ImGui::Text("G-buffer passes this frame: %zu", frame_stats.gbuffer_passes);
+    ImGui::Text("model redrawn in %zu of %zu frames", n_redraws, n_frames);
+
+    // dynamic resolution
+    static bool dynamic_resolution = resolution_scaler.is_enabled();
+    if (ImGui::Checkbox("dynamic resolution", &dynamic_resolution)) {
+        resolution_scaler.set_enabled(dynamic_resolution);
+    }
+    if (!dynamic_resolution) {
+        ImGui::BeginDisabled();
+    }
+    static float target_fps = resolution_scaler.get_target_fps();
+    if (ImGui::SliderFloat("target FPS", &target_fps, 15.0f, 144.0f, "%.0f")) {
+        resolution_scaler.set_target_fps(target_fps);
+    }
+    if (!dynamic_resolution) {
+        ImGui::EndDisabled();
+    }
+    if (resolution_scaler.get_gpu_milliseconds() >= 0.0) {
+        ImGui::Text("render scale: %.0f%% (%d x %d), model pass %.2f ms", 100.0f * resolution_scaler.get_scale(),
+            model_target.get_width(), model_target.get_height(), resolution_scaler.get_gpu_milliseconds());
+    } else {
+        ImGui::Text("render scale: %.0f%% (%d x %d)", 100.0f * resolution_scaler.get_scale(),
+            model_target.get_width(), model_target.get_height());
+    }
+    const ShaderLibrary &shaders = renderer->get_shaders();
+    ImGui::Text("shader variants: %zu, building %zu, reloads %zu",
+        shaders.get_variant_count(), shaders.get_pending_count(), shaders.get_reload_count());
 
     // fov
     static float fov = renderer->get_camera_fov();
@@ -164,22 +419,99 @@ void UI() {
         renderer->reset_camera();
     }
 
+    // texture cache
+    TextureCache &texture_cache = TextureCache::instance();
+    static int texture_cache_budget = static_cast<int>(texture_cache.get_budget() >> 20);
+    if (ImGui::SliderInt("texture cache budget (MB)", &texture_cache_budget, 16, 4096)) {
+        texture_cache.set_budget(static_cast<std::size_t>(texture_cache_budget) << 20);
+    }
+    bool compressed_textures = texture_cache.get_compression();
+    if (!texture_cache.is_compression_supported()) {
+        ImGui::BeginDisabled();
+    }
+    if (ImGui::Checkbox("compressed textures (BC1)", &compressed_textures)) {
+        texture_cache.set_compression(compressed_textures);
+        renderer->load_model(model_filepath);
+    }
+    if (!texture_cache.is_compression_supported()) {
+        ImGui::EndDisabled();
+    }
+    bool stream_textures = texture_cache.get_streaming();
+    if (ImGui::Checkbox("stream texture mip levels", &stream_textures)) {
+        texture_cache.set_streaming(stream_textures);
+        renderer->load_model(model_filepath);
+    }
+    ImGui::Text("resident textures: %zu (%.1f MB)", texture_cache.get_resident_count(), texture_cache.get_resident_bytes() / 1048576.0);
+    const TextureStreamer &texture_streamer = texture_cache.get_streamer();
+    ImGui::Text("streaming: %zu textures, %zu loading, %.1f MB in, %.1f MB out",
+        texture_streamer.get_streaming_count(), texture_streamer.get_job_count(),
+        texture_streamer.get_streamed_bytes() / 1048576.0, texture_streamer.get_dropped_bytes() / 1048576.0);
+
+    profiler_UI();
+
     ImGui::End();
 }
 
 void end_frame() {
     ImGuiIO &io = ImGui::GetIO();
-    handleInput(window, io);
-    glClearColor(0.4f, 0.4f, 0.4f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    renderer->render();
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    glfwSwapBuffers(window);
+    {
+        ProfileScope scope("input");
+        handleInput(window, io);
+    }
+    renderer->update();
+    resolution_scaler.update();
+    n_frames++;
+    // a minimized window has no size to render at
+    if (width > 0 && height > 0) {
+        const int render_width = resolution_scaler.scaled(width);
+        const int render_height = resolution_scaler.scaled(height);
+        if (!model_target.matches(render_width, render_height, model_samples)) {
+            model_target.create(render_width, render_height, model_samples);
+            renderer->set_resulution(render_width, render_height);
+        }
+        if (renderer->needs_redraw()) {
+            model_target.bind();
+            {
+                ProfileScope scope("clear", true);
+                glClearColor(0.4f, 0.4f, 0.4f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
+            resolution_scaler.begin_pass();
+            renderer->render();
+            resolution_scaler.end_pass();
+            n_redraws++;
+        }
+        if (render_width == width && render_height == height) {
+            ProfileScope scope("blit", true);
+            model_target.blit_to(0);
+            glViewport(0, 0, width, height);
+        } else {
+            ProfileScope scope("upscale", true);
+            const GLuint color = model_target.resolve();
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, width, height);
+            if (!renderer->upscale(color, render_width, render_height)) {
+                model_target.blit_resolved_to(0, width, height);
+            }
+        }
+    }
+    {
+        ProfileScope scope("imgui", true);
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
+    {
+        ProfileScope scope("swap");
+        glfwSwapBuffers(window);
+    }
+    Profiler::instance().end_frame();
 }
 
 void finalize() {
+    model_target.destroy();
+    resolution_scaler.destroy();
     renderer->destroy();
+    Profiler::instance().destroy();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -188,13 +520,22 @@ void finalize() {
 }
 
 int main() {
+    const auto start = std::chrono::steady_clock::now();
     if (!initialize()) {
         return -1;
     }
+    bool first_frame = true;
     while (!glfwWindowShouldClose(window)) {
         begin_frame();
         UI();
         end_frame();
+        if (first_frame) {
+            // tracked startup metric: until the first frame is on screen, the model still loads after that
+            glFinish();
+            const std::chrono::duration<double, std::milli> startup_time = std::chrono::steady_clock::now() - start;
+            std::cout << "[zmv] time to first frame: " << startup_time.count() << " ms" << std::endl;
+            first_frame = false;
+        }
     }
     finalize();
 }
\ No newline at end of file